@@ -0,0 +1,508 @@
+// kdtree_native.c
+// Python extension over kdtree_core. Inputs are taken through the buffer
+// protocol and results are handed back as buffers owning the C allocation,
+// so NumPy arrays go in and come out without being copied.
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include "alloc_track.h"
+#include "kd_snapshot.h"
+#include "kdtree.h"
+#include "reject_sampling.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ---------------------------------------------------------------------------
+// PointBuffer: (rows, 2) buffer owning KD_MALLOC'd memory from the core
+// library
+
+typedef struct {
+  PyObject_HEAD
+  void *data;
+  Py_ssize_t shape[2];
+  Py_ssize_t strides[2];
+  Py_ssize_t itemsize;
+  char format[2];
+} PointBuffer;
+
+static void PointBuffer_dealloc(PointBuffer *self) {
+  KD_FREE(self->data);
+  Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static int PointBuffer_getbuffer(PointBuffer *self, Py_buffer *view,
+                                 int flags) {
+  view->obj = Py_NewRef(self);
+  view->buf = self->data;
+  view->len = self->shape[0] * self->shape[1] * self->itemsize;
+  view->readonly = 0;
+  view->itemsize = self->itemsize;
+  view->format = (flags & PyBUF_FORMAT) ? self->format : NULL;
+  view->ndim = 2;
+  view->shape = (flags & PyBUF_ND) ? self->shape : NULL;
+  view->strides = (flags & PyBUF_STRIDES) ? self->strides : NULL;
+  view->suboffsets = NULL;
+  view->internal = NULL;
+  return 0;
+}
+
+static PyBufferProcs PointBuffer_as_buffer = {
+    .bf_getbuffer = (getbufferproc)PointBuffer_getbuffer,
+};
+
+static PyTypeObject PointBufferType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "kdtree_native.PointBuffer",
+    .tp_doc = "(n, 2) point buffer owned by kdtree_core",
+    .tp_basicsize = sizeof(PointBuffer),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_dealloc = (destructor)PointBuffer_dealloc,
+    .tp_as_buffer = &PointBuffer_as_buffer,
+};
+
+// Wrap `data` (rows x 2 items) and hand it to numpy.asarray when NumPy is
+// importable; either way the memory is shared, not copied. Takes ownership
+// of `data`.
+static PyObject *WrapPoints(void *data, Py_ssize_t rows, char format,
+                            Py_ssize_t itemsize) {
+  PointBuffer *buffer = PyObject_New(PointBuffer, &PointBufferType);
+  if (buffer == NULL) {
+    KD_FREE(data);
+    return NULL;
+  }
+  buffer->data = data;
+  buffer->shape[0] = rows;
+  buffer->shape[1] = 2;
+  buffer->strides[0] = 2 * itemsize;
+  buffer->strides[1] = itemsize;
+  buffer->itemsize = itemsize;
+  buffer->format[0] = format;
+  buffer->format[1] = '\0';
+
+  PyObject *numpy = PyImport_ImportModule("numpy");
+  if (numpy == NULL) {
+    PyErr_Clear();
+    return (PyObject *)buffer;
+  }
+  PyObject *array = PyObject_CallMethod(numpy, "asarray", "O", buffer);
+  Py_DECREF(numpy);
+  Py_DECREF(buffer);
+  return array;
+}
+
+// Borrow a C-contiguous (n, 2) float32 buffer
+static int GetPointsBuffer(PyObject *obj, Py_buffer *view, int writable) {
+  int flags = PyBUF_C_CONTIGUOUS | PyBUF_FORMAT;
+  if (writable)
+    flags |= PyBUF_WRITABLE;
+  if (PyObject_GetBuffer(obj, view, flags) < 0)
+    return -1;
+  if (view->ndim != 2 || view->shape[1] != 2 ||
+      view->itemsize != sizeof(float) || strcmp(view->format, "f") != 0) {
+    PyErr_SetString(PyExc_ValueError,
+                    "expected a C-contiguous float32 array of shape (n, 2)");
+    PyBuffer_Release(view);
+    return -1;
+  }
+  return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Module functions
+
+static PyObject *distribute_points(PyObject *self, PyObject *args,
+                                   PyObject *kwargs) {
+  static char *kwlist[] = {"image", "num_points", "min_distance", NULL};
+  PyObject *image_obj;
+  int num_points;
+  float min_distance = 1.0f;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Oi|f", kwlist, &image_obj,
+                                   &num_points, &min_distance))
+    return NULL;
+
+  if (num_points <= 0) {
+    PyErr_SetString(PyExc_ValueError, "num_points must be positive");
+    return NULL;
+  }
+  Py_buffer view;
+  if (PyObject_GetBuffer(image_obj, &view,
+                         PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) < 0)
+    return NULL;
+  if (view.ndim != 2 || view.itemsize != 1 || strcmp(view.format, "B") != 0) {
+    PyErr_SetString(PyExc_ValueError,
+                    "expected a C-contiguous uint8 image of shape (h, w)");
+    PyBuffer_Release(&view);
+    return NULL;
+  }
+  if (view.shape[0] <= 0 || view.shape[1] <= 0 || view.shape[0] > 65536 ||
+      view.shape[1] > 65536) {
+    PyErr_SetString(PyExc_ValueError,
+                    "image sides must be between 1 and 65536 pixels");
+    PyBuffer_Release(&view);
+    return NULL;
+  }
+  // Only pixels darker than white can receive points
+  const unsigned char *pixels = view.buf;
+  Py_ssize_t pixel_count = view.shape[0] * view.shape[1];
+  Py_ssize_t first_dark = 0;
+  while (first_dark < pixel_count && pixels[first_dark] == 255)
+    first_dark++;
+  if (first_dark == pixel_count) {
+    PyErr_SetString(PyExc_ValueError, "image has no dark pixels");
+    PyBuffer_Release(&view);
+    return NULL;
+  }
+
+  GrayImage img = {view.buf, (int)view.shape[1], (int)view.shape[0]};
+  int accepted = 0;
+  Point *points = NULL;
+  Py_BEGIN_ALLOW_THREADS
+  points = distribute_points_on_gray(&img, num_points, min_distance, &accepted);
+  Py_END_ALLOW_THREADS
+  PyBuffer_Release(&view);
+
+  if (points == NULL)
+    return PyErr_NoMemory();
+  return WrapPoints(points, accepted, 'H', sizeof(uint16_t));
+}
+
+static PyObject *resample_points(PyObject *self, PyObject *args) {
+  PyObject *points_obj;
+  int new_count;
+  if (!PyArg_ParseTuple(args, "Oi", &points_obj, &new_count))
+    return NULL;
+
+  Py_buffer view;
+  if (GetPointsBuffer(points_obj, &view, 0) < 0)
+    return NULL;
+  Vector2 *resampled =
+      ResamplePoints(view.buf, (int)view.shape[0], new_count);
+  PyBuffer_Release(&view);
+
+  if (resampled == NULL) {
+    PyErr_SetString(PyExc_ValueError, "need at least one point to resample");
+    return NULL;
+  }
+  return WrapPoints(resampled, new_count, 'f', sizeof(float));
+}
+
+// ---------------------------------------------------------------------------
+// KDTree type
+
+typedef struct {
+  PyObject_HEAD
+  TreeNode *root;
+  KDQueryStats queryStats; // accumulated by range_count / range_report
+} KDTreeObject;
+
+static void KDTree_dealloc(KDTreeObject *self) {
+  freeTree(self->root);
+  Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static int KDTree_init(KDTreeObject *self, PyObject *args, PyObject *kwargs) {
+  static char *kwlist[] = {"origin", "target", "interpolation", "split", NULL};
+  PyObject *origin_obj;
+  PyObject *target_obj = Py_None;
+  double interpolation = 1.0;
+  const char *split = "median";
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|Ods", kwlist, &origin_obj,
+                                   &target_obj, &interpolation, &split))
+    return -1;
+
+  KDBuildOptions options = {.policy = KD_SPLIT_POLICY_COUNT};
+  for (int i = 0; i < KD_SPLIT_POLICY_COUNT; i++) {
+    if (strcmp(split, KDSplitPolicyName((KDSplitPolicy)i)) == 0)
+      options.policy = (KDSplitPolicy)i;
+  }
+  if (options.policy == KD_SPLIT_POLICY_COUNT) {
+    PyErr_Format(PyExc_ValueError,
+                 "unknown split '%s', expected median, widest, midpoint "
+                 "or cost",
+                 split);
+    return -1;
+  }
+  // Splits and FindLiveNode rely on the interpolated ranks staying in order,
+  // which only holds between the two sets (NaN fails the check too)
+  if (!(interpolation >= 0.0 && interpolation <= 1.0)) {
+    PyErr_SetString(PyExc_ValueError, "interpolation must be within [0, 1]");
+    return -1;
+  }
+
+  // Both sets are sorted in place by the build, exactly like the C callers
+  Py_buffer origin;
+  Py_buffer target;
+  if (GetPointsBuffer(origin_obj, &origin, 1) < 0)
+    return -1;
+  if (target_obj == Py_None) {
+    target = origin;
+  } else if (GetPointsBuffer(target_obj, &target, 1) < 0) {
+    PyBuffer_Release(&origin);
+    return -1;
+  } else if (target.shape[0] != origin.shape[0]) {
+    PyErr_SetString(PyExc_ValueError,
+                    "origin and target need the same number of points, "
+                    "see resample_points");
+    PyBuffer_Release(&origin);
+    PyBuffer_Release(&target);
+    return -1;
+  }
+
+  // Other threads may query the old tree while the GIL is released, so it is
+  // only replaced and freed once the new one is complete
+  TreeNode *root;
+  Py_BEGIN_ALLOW_THREADS
+  root = buildKDTreeEx(origin.buf, target.buf, (int)origin.shape[0], 0, NULL,
+                       interpolation, &options);
+  Py_END_ALLOW_THREADS
+
+  // A failed build keeps the previous tree
+  bool built = root != NULL || origin.shape[0] == 0;
+  if (built) {
+    TreeNode *old = self->root;
+    self->root = root;
+    self->queryStats = (KDQueryStats){0};
+    freeTree(old);
+  }
+
+  if (target_obj != Py_None)
+    PyBuffer_Release(&target);
+  PyBuffer_Release(&origin);
+  if (!built) {
+    PyErr_NoMemory();
+    return -1;
+  }
+  return 0;
+}
+
+static Py_ssize_t KDTree_len(KDTreeObject *self) {
+  return self->root ? self->root->count : 0;
+}
+
+static PyObject *KDTree_range_count(KDTreeObject *self, PyObject *args) {
+  Rectangle range;
+  if (!PyArg_ParseTuple(args, "ffff", &range.x, &range.y, &range.width,
+                        &range.height))
+    return NULL;
+  return PyLong_FromLong(
+      CountKDTreeRangeEx(self->root, range, &self->queryStats));
+}
+
+static PyObject *KDTree_range_report(KDTreeObject *self, PyObject *args) {
+  Rectangle range;
+  if (!PyArg_ParseTuple(args, "ffff", &range.x, &range.y, &range.width,
+                        &range.height))
+    return NULL;
+  int count = CountKDTreeRangeEx(self->root, range, &self->queryStats);
+  Vector2 *points =
+      KD_MALLOC(ALLOC_KDTREE, (count > 0 ? count : 1) * sizeof(Vector2));
+  if (points == NULL)
+    return PyErr_NoMemory();
+  ReportKDTreeRange(self->root, range, points, count);
+  return WrapPoints(points, count, 'f', sizeof(float));
+}
+
+static PyObject *KDTree_insert(KDTreeObject *self, PyObject *args) {
+  Vector2 point;
+  if (!PyArg_ParseTuple(args, "ff", &point.x, &point.y))
+    return NULL;
+  self->root = InsertKDTree(self->root, point);
+  Py_RETURN_NONE;
+}
+
+static PyObject *KDTree_delete(KDTreeObject *self, PyObject *args) {
+  Vector2 point;
+  if (!PyArg_ParseTuple(args, "ff", &point.x, &point.y))
+    return NULL;
+  int before = self->root ? self->root->count : 0;
+  self->root = DeleteKDTree(self->root, point);
+  int after = self->root ? self->root->count : 0;
+  return PyBool_FromLong(after < before);
+}
+
+static PyObject *KDTree_stats(KDTreeObject *self, PyObject *Py_UNUSED(args)) {
+  KDTreeStats stats = GetKDTreeStats(self->root);
+  return Py_BuildValue("{s:i,s:i,s:i,s:d,s:L,s:L}", "nodes", stats.nodes,
+                       "leaves", stats.leaves, "depth", stats.depth,
+                       "mean_leaf_depth", stats.meanLeafDepth, "queries",
+                       self->queryStats.queries, "nodes_visited",
+                       self->queryStats.nodesVisited);
+}
+
+static PyObject *KDTree_save(KDTreeObject *self, PyObject *args) {
+  PyObject *path_obj;
+  if (!PyArg_ParseTuple(args, "O&", PyUnicode_FSConverter, &path_obj))
+    return NULL;
+  bool ok = WriteKDSnapshot(self->root, PyBytes_AS_STRING(path_obj));
+  if (!ok) {
+    PyErr_SetFromErrnoWithFilename(PyExc_OSError,
+                                   PyBytes_AS_STRING(path_obj));
+    Py_DECREF(path_obj);
+    return NULL;
+  }
+  Py_DECREF(path_obj);
+  Py_RETURN_NONE;
+}
+
+static PyMethodDef KDTree_methods[] = {
+    {"range_count", (PyCFunction)KDTree_range_count, METH_VARARGS,
+     "range_count(x, y, width, height) -> number of points in the rectangle"},
+    {"range_report", (PyCFunction)KDTree_range_report, METH_VARARGS,
+     "range_report(x, y, width, height) -> (k, 2) float32 points"},
+    {"insert", (PyCFunction)KDTree_insert, METH_VARARGS,
+     "insert(x, y) -> None"},
+    {"delete", (PyCFunction)KDTree_delete, METH_VARARGS,
+     "delete(x, y) -> True if a point was removed"},
+    {"save", (PyCFunction)KDTree_save, METH_VARARGS,
+     "save(path) -> None, write a snapshot loadable with Snapshot(path)"},
+    {"stats", (PyCFunction)KDTree_stats, METH_NOARGS,
+     "stats() -> dict of tree shape and nodes visited by range queries"},
+    {NULL, NULL, 0, NULL},
+};
+
+static PySequenceMethods KDTree_as_sequence = {
+    .sq_length = (lenfunc)KDTree_len,
+};
+
+static PyTypeObject KDTreeType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "kdtree_native.KDTree",
+    .tp_doc = "KDTree(origin, target=None, interpolation=1.0, split='median')\n"
+              "\nBuild over (n, 2) float32 arrays; both are sorted in place.\n"
+              "split is one of median, widest, midpoint or cost; interpolation\n"
+              "must be within [0, 1].",
+    .tp_basicsize = sizeof(KDTreeObject),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_new = PyType_GenericNew,
+    .tp_init = (initproc)KDTree_init,
+    .tp_dealloc = (destructor)KDTree_dealloc,
+    .tp_methods = KDTree_methods,
+    .tp_as_sequence = &KDTree_as_sequence,
+};
+
+// ---------------------------------------------------------------------------
+// Snapshot type: read-only tree mapped from a KDTree.save file
+
+typedef struct {
+  PyObject_HEAD
+  KDSnapshot snapshot;
+} SnapshotObject;
+
+static void Snapshot_dealloc(SnapshotObject *self) {
+  UnloadKDSnapshot(&self->snapshot);
+  Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static int Snapshot_init(SnapshotObject *self, PyObject *args,
+                         PyObject *kwargs) {
+  static char *kwlist[] = {"path", "verify", NULL};
+  PyObject *path_obj;
+  int verify = 0;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O&|p", kwlist,
+                                   PyUnicode_FSConverter, &path_obj, &verify))
+    return -1;
+
+  UnloadKDSnapshot(&self->snapshot);
+  bool ok = LoadKDSnapshot(&self->snapshot, PyBytes_AS_STRING(path_obj),
+                           verify);
+  if (!ok && errno != 0)
+    PyErr_SetFromErrnoWithFilename(PyExc_OSError, PyBytes_AS_STRING(path_obj));
+  else if (!ok)
+    PyErr_Format(PyExc_ValueError, "'%s' is not a valid kd-tree snapshot",
+                 PyBytes_AS_STRING(path_obj));
+  Py_DECREF(path_obj);
+  return ok ? 0 : -1;
+}
+
+static Py_ssize_t Snapshot_len(SnapshotObject *self) {
+  return self->snapshot.nodeCount > 0 ? self->snapshot.nodes[0].count : 0;
+}
+
+static PyObject *Snapshot_range_count(SnapshotObject *self, PyObject *args) {
+  Rectangle range;
+  if (!PyArg_ParseTuple(args, "ffff", &range.x, &range.y, &range.width,
+                        &range.height))
+    return NULL;
+  return PyLong_FromLong(CountKDSnapshotRange(&self->snapshot, range));
+}
+
+static PyObject *Snapshot_range_report(SnapshotObject *self, PyObject *args) {
+  Rectangle range;
+  if (!PyArg_ParseTuple(args, "ffff", &range.x, &range.y, &range.width,
+                        &range.height))
+    return NULL;
+  int count = CountKDSnapshotRange(&self->snapshot, range);
+  Vector2 *points =
+      KD_MALLOC(ALLOC_KDTREE, (count > 0 ? count : 1) * sizeof(Vector2));
+  if (points == NULL)
+    return PyErr_NoMemory();
+  ReportKDSnapshotRange(&self->snapshot, range, points, count);
+  return WrapPoints(points, count, 'f', sizeof(float));
+}
+
+static PyMethodDef Snapshot_methods[] = {
+    {"range_count", (PyCFunction)Snapshot_range_count, METH_VARARGS,
+     "range_count(x, y, width, height) -> number of points in the rectangle"},
+    {"range_report", (PyCFunction)Snapshot_range_report, METH_VARARGS,
+     "range_report(x, y, width, height) -> (k, 2) float32 points"},
+    {NULL, NULL, 0, NULL},
+};
+
+static PySequenceMethods Snapshot_as_sequence = {
+    .sq_length = (lenfunc)Snapshot_len,
+};
+
+static PyTypeObject SnapshotType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "kdtree_native.Snapshot",
+    .tp_doc = "Snapshot(path, verify=False)\n\n"
+              "Map a KDTree.save file read-only and query it in place; "
+              "verify checks the checksum.",
+    .tp_basicsize = sizeof(SnapshotObject),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_new = PyType_GenericNew,
+    .tp_init = (initproc)Snapshot_init,
+    .tp_dealloc = (destructor)Snapshot_dealloc,
+    .tp_methods = Snapshot_methods,
+    .tp_as_sequence = &Snapshot_as_sequence,
+};
+
+// ---------------------------------------------------------------------------
+// Module
+
+static PyMethodDef module_methods[] = {
+    {"distribute_points", (PyCFunction)(void (*)(void))distribute_points,
+     METH_VARARGS | METH_KEYWORDS,
+     "distribute_points(image, num_points, min_distance=1.0) -> (n, 2) uint16\n"
+     "\nRejection-sample points on a uint8 (h, w) image, darker is denser.\n"
+     "Raises ValueError for an empty or all-white image."},
+    {"resample_points", resample_points, METH_VARARGS,
+     "resample_points(points, new_count) -> (new_count, 2) float32"},
+    {NULL, NULL, 0, NULL},
+};
+
+static struct PyModuleDef module_def = {
+    PyModuleDef_HEAD_INIT,
+    .m_name = "kdtree_native",
+    .m_doc = "Native kd-tree and sampler from kdtree_core",
+    .m_size = -1,
+    .m_methods = module_methods,
+};
+
+PyMODINIT_FUNC PyInit_kdtree_native(void) {
+  if (PyType_Ready(&PointBufferType) < 0 || PyType_Ready(&KDTreeType) < 0 ||
+      PyType_Ready(&SnapshotType) < 0)
+    return NULL;
+
+  PyObject *module = PyModule_Create(&module_def);
+  if (module == NULL)
+    return NULL;
+  if (PyModule_AddObjectRef(module, "KDTree", (PyObject *)&KDTreeType) < 0 ||
+      PyModule_AddObjectRef(module, "Snapshot", (PyObject *)&SnapshotType) <
+          0) {
+    Py_DECREF(module);
+    return NULL;
+  }
+  return module;
+}
@@ -0,0 +1,179 @@
+#include "alloc_track.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char *subsystemNames[ALLOC_SUBSYSTEM_COUNT] = {
+    "sampler", "kdtree", "dynamic_array", "pipeline"};
+
+static pthread_mutex_t trackMutex = PTHREAD_MUTEX_INITIALIZER;
+static AllocStats stats[ALLOC_SUBSYSTEM_COUNT];
+
+#ifdef KDTREE_TRACK_ALLOC
+// Prepended to every tracked block; the union keeps the user pointer
+// aligned like malloc's
+typedef union AllocHeader {
+  struct {
+    size_t size;
+    const char *file;
+    int line;
+    AllocSubsystem subsystem;
+    union AllocHeader *prev;
+    union AllocHeader *next;
+  } info;
+  max_align_t align;
+} AllocHeader;
+
+static AllocHeader *liveList = NULL;
+
+static void *Track(AllocHeader *header, AllocSubsystem subsystem, size_t size,
+                   const char *file, int line) {
+  if (header == NULL)
+    return NULL;
+  header->info.size = size;
+  header->info.file = file;
+  header->info.line = line;
+  header->info.subsystem = subsystem;
+
+  pthread_mutex_lock(&trackMutex);
+  header->info.prev = NULL;
+  header->info.next = liveList;
+  if (liveList)
+    liveList->info.prev = header;
+  liveList = header;
+
+  AllocStats *s = &stats[subsystem];
+  s->liveBytes += size;
+  s->liveBlocks++;
+  s->totalAllocs++;
+  if (s->liveBytes > s->peakBytes)
+    s->peakBytes = s->liveBytes;
+  pthread_mutex_unlock(&trackMutex);
+  return header + 1;
+}
+
+static AllocHeader *Untrack(void *ptr) {
+  AllocHeader *header = (AllocHeader *)ptr - 1;
+  pthread_mutex_lock(&trackMutex);
+  if (header->info.prev)
+    header->info.prev->info.next = header->info.next;
+  else
+    liveList = header->info.next;
+  if (header->info.next)
+    header->info.next->info.prev = header->info.prev;
+
+  AllocStats *s = &stats[header->info.subsystem];
+  s->liveBytes -= header->info.size;
+  s->liveBlocks--;
+  pthread_mutex_unlock(&trackMutex);
+  return header;
+}
+#endif
+
+void *TrackedMalloc(AllocSubsystem subsystem, size_t size, const char *file,
+                    int line) {
+#ifdef KDTREE_TRACK_ALLOC
+  if (size > SIZE_MAX - sizeof(AllocHeader))
+    return NULL;
+  return Track(malloc(sizeof(AllocHeader) + size), subsystem, size, file,
+               line);
+#else
+  return malloc(size);
+#endif
+}
+
+void *TrackedCalloc(AllocSubsystem subsystem, size_t count, size_t size,
+                    const char *file, int line) {
+  if (size && count > SIZE_MAX / size)
+    return NULL;
+  void *ptr = TrackedMalloc(subsystem, count * size, file, line);
+  if (ptr)
+    memset(ptr, 0, count * size);
+  return ptr;
+}
+
+void *TrackedRealloc(AllocSubsystem subsystem, void *ptr, size_t size,
+                     const char *file, int line) {
+#ifdef KDTREE_TRACK_ALLOC
+  if (ptr == NULL)
+    return TrackedMalloc(subsystem, size, file, line);
+  if (size > SIZE_MAX - sizeof(AllocHeader))
+    return NULL;
+  AllocHeader *header = Untrack(ptr);
+  AllocHeader *grown = realloc(header, sizeof(AllocHeader) + size);
+  if (grown == NULL) {
+    // The old block is still valid, put it back on the books
+    Track(header, header->info.subsystem, header->info.size, header->info.file,
+          header->info.line);
+    return NULL;
+  }
+  return Track(grown, subsystem, size, file, line);
+#else
+  return realloc(ptr, size);
+#endif
+}
+
+void TrackedFree(void *ptr) {
+  if (ptr == NULL)
+    return;
+#ifdef KDTREE_TRACK_ALLOC
+  free(Untrack(ptr));
+#else
+  free(ptr);
+#endif
+}
+
+bool AllocTrackingEnabled(void) {
+#ifdef KDTREE_TRACK_ALLOC
+  return true;
+#else
+  return false;
+#endif
+}
+
+AllocStats GetAllocStats(AllocSubsystem subsystem) {
+  pthread_mutex_lock(&trackMutex);
+  AllocStats s = stats[subsystem];
+  pthread_mutex_unlock(&trackMutex);
+  return s;
+}
+
+void ReportAllocStats(FILE *out) {
+  static double lastTime = 0.0;
+  static unsigned long long lastAllocs[ALLOC_SUBSYSTEM_COUNT];
+
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  double now = ts.tv_sec + ts.tv_nsec * 1e-9;
+  double elapsed = lastTime > 0.0 ? now - lastTime : 0.0;
+  lastTime = now;
+
+  fprintf(out, "%-14s %12s %12s %8s %10s\n", "subsystem", "live bytes",
+          "peak bytes", "blocks", "allocs/s");
+  for (int i = 0; i < ALLOC_SUBSYSTEM_COUNT; i++) {
+    AllocStats s = GetAllocStats((AllocSubsystem)i);
+    double rate =
+        elapsed > 0.0 ? (s.totalAllocs - lastAllocs[i]) / elapsed : 0.0;
+    lastAllocs[i] = s.totalAllocs;
+    fprintf(out, "%-14s %12zu %12zu %8zu %10.1f\n", subsystemNames[i],
+            s.liveBytes, s.peakBytes, s.liveBlocks, rate);
+  }
+}
+
+int ReportOutstandingAllocs(FILE *out) {
+  int count = 0;
+#ifdef KDTREE_TRACK_ALLOC
+  pthread_mutex_lock(&trackMutex);
+  for (AllocHeader *h = liveList; h != NULL; h = h->info.next) {
+    fprintf(out, "outstanding: %zu bytes [%s] at %s:%d\n", h->info.size,
+            subsystemNames[h->info.subsystem], h->info.file, h->info.line);
+    count++;
+  }
+  pthread_mutex_unlock(&trackMutex);
+#else
+  (void)out;
+#endif
+  return count;
+}
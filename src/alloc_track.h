@@ -0,0 +1,56 @@
+#ifndef _ALLOC_TRACK
+#define _ALLOC_TRACK
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Allocation accounting per subsystem. Every heap block handed between
+// modules goes through KD_MALLOC/KD_FREE so ownership can be audited. The
+// macros always call the Tracked* functions, and only alloc_track.c is
+// compiled with or without KDTREE_TRACK_ALLOC, so every module that links
+// kdtree_core agrees on the block layout. When tracking is on each block
+// carries a small header recording its size, subsystem and call site;
+// otherwise the functions are plain libc calls. A block may be freed by a
+// different thread or module than the one that allocated it: the header,
+// not the caller, decides whose counters drop.
+typedef enum AllocSubsystem {
+  ALLOC_SAMPLER,        // reject_sampling.c, glyph atlas
+  ALLOC_KDTREE,         // kdtree.c, kd_batch.c
+  ALLOC_DYNAMIC_ARRAY,  // dynamic_array.c
+  ALLOC_PIPELINE,       // producer/consumer point buffers, message queue
+  ALLOC_SUBSYSTEM_COUNT
+} AllocSubsystem;
+
+typedef struct AllocStats {
+  size_t liveBytes;
+  size_t peakBytes;
+  size_t liveBlocks;
+  unsigned long long totalAllocs;
+} AllocStats;
+
+#define KD_MALLOC(subsystem, size)                                             \
+  TrackedMalloc((subsystem), (size), __FILE__, __LINE__)
+#define KD_CALLOC(subsystem, count, size)                                      \
+  TrackedCalloc((subsystem), (count), (size), __FILE__, __LINE__)
+#define KD_REALLOC(subsystem, ptr, size)                                       \
+  TrackedRealloc((subsystem), (ptr), (size), __FILE__, __LINE__)
+#define KD_FREE(ptr) TrackedFree(ptr)
+
+void *TrackedMalloc(AllocSubsystem subsystem, size_t size, const char *file,
+                    int line);
+void *TrackedCalloc(AllocSubsystem subsystem, size_t count, size_t size,
+                    const char *file, int line);
+void *TrackedRealloc(AllocSubsystem subsystem, void *ptr, size_t size,
+                     const char *file, int line);
+void TrackedFree(void *ptr);
+// Whether kdtree_core was built with KDTREE_TRACK_ALLOC
+bool AllocTrackingEnabled(void);
+
+// Snapshot of one subsystem's counters (all zero when tracking is off)
+AllocStats GetAllocStats(AllocSubsystem subsystem);
+// Print live/peak bytes and allocations per second since the previous call
+void ReportAllocStats(FILE *out);
+// Print every block still allocated and return how many there are. Prints
+// nothing and returns 0 when tracking is off.
+int ReportOutstandingAllocs(FILE *out);
+#endif
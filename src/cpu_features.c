@@ -0,0 +1,41 @@
+#include "cpu_features.h"
+#include <stdatomic.h>
+
+// -1 until the first query, so the CPU is only probed once
+static atomic_int currentLevel = -1;
+
+static KDSimdLevel DetectKDSimdLevel(void) {
+#if KD_HAVE_X86_SIMD
+  return CpuHasAVX2() ? KD_SIMD_AVX2 : KD_SIMD_SSE2;
+#else
+  return KD_SIMD_SCALAR;
+#endif
+}
+
+KDSimdLevel GetKDSimdLevel(void) {
+  int level = atomic_load(&currentLevel);
+  if (level < 0) {
+    level = DetectKDSimdLevel();
+    atomic_store(&currentLevel, level);
+  }
+  return (KDSimdLevel)level;
+}
+
+KDSimdLevel SetKDSimdLevel(KDSimdLevel level) {
+  KDSimdLevel best = DetectKDSimdLevel();
+  if (level < KD_SIMD_SCALAR)
+    level = KD_SIMD_SCALAR;
+  if (level > best)
+    level = best;
+  atomic_store(&currentLevel, level);
+  return level;
+}
+
+static const char *const kSimdLevelNames[KD_SIMD_LEVEL_COUNT] = {
+    "scalar", "sse2", "avx2"};
+
+const char *KDSimdLevelName(KDSimdLevel level) {
+  if (level < 0 || level >= KD_SIMD_LEVEL_COUNT)
+    return "unknown";
+  return kSimdLevelNames[level];
+}
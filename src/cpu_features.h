@@ -0,0 +1,36 @@
+#ifndef _CPU_FEATURES
+#define _CPU_FEATURES
+// Compile-time and runtime SIMD availability. SSE2 is baseline on x86-64, so
+// only AVX2 needs a runtime check; kernels tagged KD_TARGET_AVX2 must only be
+// called when CpuHasAVX2() is true. Other targets fall back to scalar code.
+#include <stdbool.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__)) &&        \
+    !defined(__EMSCRIPTEN__)
+#define KD_HAVE_X86_SIMD 1
+#include <immintrin.h>
+#define KD_TARGET_AVX2 __attribute__((target("avx2,fma")))
+static inline bool CpuHasAVX2(void) {
+  return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+}
+#else
+#define KD_HAVE_X86_SIMD 0
+static inline bool CpuHasAVX2(void) { return false; }
+#endif
+
+// Kernel flavours in increasing order. Batch kernels dispatch on
+// GetKDSimdLevel(), which starts at the best level this CPU supports.
+typedef enum KDSimdLevel {
+  KD_SIMD_SCALAR,
+  KD_SIMD_SSE2,
+  KD_SIMD_AVX2,
+  KD_SIMD_LEVEL_COUNT,
+} KDSimdLevel;
+
+KDSimdLevel GetKDSimdLevel(void);
+// Force a lower level, e.g. to compare kernels against the scalar path.
+// Requests above what the CPU supports are clamped; returns the level set.
+KDSimdLevel SetKDSimdLevel(KDSimdLevel level);
+const char *KDSimdLevelName(KDSimdLevel level);
+
+#endif
@@ -1,16 +1,18 @@
 #include "dynamic_array.h"
+#include "alloc_track.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 // 初始化动态数组
 DynamicArray* da_init(size_t initial_capacity, size_t element_size) {
-    DynamicArray *da = malloc(sizeof(DynamicArray));
+    DynamicArray *da = KD_MALLOC(ALLOC_DYNAMIC_ARRAY, sizeof(DynamicArray));
     if (!da) return NULL;
     
-    da->array = malloc(initial_capacity * sizeof(void*));
+    da->array = KD_MALLOC(ALLOC_DYNAMIC_ARRAY,
+                          initial_capacity * sizeof(void*));
     if (!da->array) {
-        free(da);
+        KD_FREE(da);
         return NULL;
     }
     
@@ -25,7 +27,7 @@ void da_clear(DynamicArray *da) {
     
     // 释放所有元素内存
     for (size_t i = 0; i < da->size; i++) {
-        free(da->array[i]);
+        KD_FREE(da->array[i]);
     }
     
     da->size = 0;
@@ -42,17 +44,18 @@ void da_free(DynamicArray *da) {
     if (da) {
         // 先释放所有元素内存
         for (size_t i = 0; i < da->size; i++) {
-            free(da->array[i]);
+            KD_FREE(da->array[i]);
         }
         // 再释放数组和结构体
-        free(da->array);
-        free(da);
+        KD_FREE(da->array);
+        KD_FREE(da);
     }
 }
 
 // 扩容动态数组
 static int da_resize(DynamicArray *da, size_t new_capacity) {
-    void **new_array = realloc(da->array, new_capacity * sizeof(void*));
+    void **new_array = KD_REALLOC(ALLOC_DYNAMIC_ARRAY, da->array,
+                                  new_capacity * sizeof(void*));
     if (!new_array) return 0; // 扩容失败
     
     da->array = new_array;
@@ -71,7 +74,7 @@ int da_push(DynamicArray *da, const void *element) {
     }
     
     // 分配新元素内存并复制数据
-    void *new_element = malloc(da->element_size);
+    void *new_element = KD_MALLOC(ALLOC_DYNAMIC_ARRAY, da->element_size);
     if (!new_element) return 0;
     
     memcpy(new_element, element, da->element_size);
@@ -90,7 +93,7 @@ int da_pop(DynamicArray *da, void *element) {
     }
     
     // 释放元素内存
-    free(da->array[--da->size]);
+    KD_FREE(da->array[--da->size]);
     
     // 如果元素数量减少到容量的1/4，缩小容量为原来的1/2
     if (da->size > 0 && da->size == da->capacity / 4) {
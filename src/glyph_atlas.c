@@ -0,0 +1,57 @@
+#include "glyph_atlas.h"
+#include "alloc_track.h"
+#include <stdlib.h>
+#include <string.h>
+
+static int FindGlyph(const GlyphAtlas *atlas, char c) {
+  for (int i = 0; i < atlas->glyphCount; i++) {
+    if (atlas->chars[i] == c)
+      return i;
+  }
+  return -1;
+}
+
+void UnloadGlyphAtlas(GlyphAtlas *atlas) {
+  KD_FREE(atlas->coverage);
+  memset(atlas, 0, sizeof(GlyphAtlas));
+}
+
+void RasterizeGlyphText(const GlyphAtlas *atlas, const char *text,
+                        GrayImage *target) {
+  memset(target->data, 255, (size_t)target->width * target->height);
+
+  // Center on the spacing-free width, then draw with spacing, which is what
+  // MeasureTextEx(..., 0) + ImageDrawTextEx(..., spacing) did before
+  int textWidth = 0;
+  for (const char *c = text; *c; c++) {
+    int glyph = FindGlyph(atlas, *c);
+    if (glyph >= 0)
+      textWidth += atlas->glyphWidth[glyph];
+  }
+  float penX = (target->width - textWidth) / 2.0f;
+  int top = (int)((target->height - atlas->atlasHeight) / 2.0f);
+
+  for (const char *c = text; *c; c++) {
+    int glyph = FindGlyph(atlas, *c);
+    if (glyph < 0)
+      continue;
+    int left = (int)penX;
+    int width = atlas->glyphWidth[glyph];
+    for (int y = 0; y < atlas->atlasHeight; y++) {
+      int ty = top + y;
+      if (ty < 0 || ty >= target->height)
+        continue;
+      const unsigned char *src =
+          atlas->coverage + y * atlas->atlasWidth + atlas->glyphX[glyph];
+      unsigned char *dst = target->data + ty * target->width;
+      for (int x = 0; x < width; x++) {
+        int tx = left + x;
+        if (tx < 0 || tx >= target->width || src[x] == 0)
+          continue;
+        // Black ink over whatever is there: dst * (1 - coverage)
+        dst[tx] = (unsigned char)(dst[tx] * (255 - src[x]) / 255);
+      }
+    }
+    penX += width + atlas->spacing;
+  }
+}
@@ -0,0 +1,33 @@
+#ifndef _GLYPH_ATLAS
+#define _GLYPH_ATLAS
+#include "kd_types.h"
+
+#define GLYPH_ATLAS_MAX_GLYPHS 32
+
+// Pre-rendered 8-bit coverage strips for a small character set (the clock
+// digits). Built once from a raylib Font, then read-only: rasterizing text
+// from it touches no raylib state and allocates nothing, so the producer
+// thread can use it freely.
+typedef struct GlyphAtlas {
+  unsigned char *coverage;  // atlasWidth x atlasHeight, 255 = full ink
+  int atlasWidth;
+  int atlasHeight;
+  int glyphCount;
+  float spacing;            // extra advance between glyphs, in pixels
+  char chars[GLYPH_ATLAS_MAX_GLYPHS + 1];
+  int glyphX[GLYPH_ATLAS_MAX_GLYPHS];      // glyph column in the atlas
+  int glyphWidth[GLYPH_ATLAS_MAX_GLYPHS];  // glyph advance, in pixels
+} GlyphAtlas;
+
+#ifndef KDTREE_CORE
+// Render every character of `chars` at `fontSize` into a new atlas. Game
+// only, see raylib_bridge.c
+bool LoadGlyphAtlas(GlyphAtlas *atlas, Font font, int fontSize, float spacing,
+                    const char *chars);
+#endif
+void UnloadGlyphAtlas(GlyphAtlas *atlas);
+// Clear `target` to white and composite `text` centered on it in black, laid
+// out like ImageDrawTextEx. Characters missing from the atlas are skipped.
+void RasterizeGlyphText(const GlyphAtlas *atlas, const char *text,
+                        GrayImage *target);
+#endif
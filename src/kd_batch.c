@@ -0,0 +1,357 @@
+#include "kd_batch.h"
+#include "alloc_track.h"
+#include "cpu_features.h"
+#include "kdtree_instances.h"
+#include "simplex.h"
+#include <stdlib.h>
+#include <string.h>
+
+void InitKDBatch(KDBatch *batch) { memset(batch, 0, sizeof(KDBatch)); }
+
+void FreeKDBatch(KDBatch *batch) {
+  KD_FREE(batch->originSplit);
+  KD_FREE(batch->targetSplit);
+  KD_FREE(batch->split);
+  KD_FREE(batch->axis);
+  KD_FREE(batch->lowRef);
+  KD_FREE(batch->highRef);
+  KD_FREE(batch->cellLowRef);
+  KD_FREE(batch->cellHighRef);
+  KD_FREE(batch->subtreeEnd);
+  KD_FREE(batch->progress);
+  KD_FREE(batch->eased);
+  KD_FREE(batch->slotOffset);
+  KD_FREE(batch->nodeCount);
+  InitKDBatch(batch);
+}
+
+void ClearKDBatch(KDBatch *batch) {
+  batch->slotCount = 0;
+  batch->treeCount = 0;
+}
+
+static bool GrowArray(void **array, int capacity, size_t elementSize) {
+  void *grown = KD_REALLOC(ALLOC_KDTREE, *array, capacity * elementSize);
+  if (!grown)
+    return false;
+  *array = grown;
+  return true;
+}
+
+static bool ReserveSlots(KDBatch *batch, int slots) {
+  if (slots <= batch->slotCapacity)
+    return true;
+  int capacity = batch->slotCapacity ? batch->slotCapacity : 1024;
+  while (capacity < slots)
+    capacity *= 2;
+  if (!GrowArray((void **)&batch->originSplit, capacity, sizeof(float)) ||
+      !GrowArray((void **)&batch->targetSplit, capacity, sizeof(float)) ||
+      !GrowArray((void **)&batch->split, capacity, sizeof(float)) ||
+      !GrowArray((void **)&batch->axis, capacity, sizeof(unsigned char)) ||
+      !GrowArray((void **)&batch->lowRef, capacity, sizeof(int)) ||
+      !GrowArray((void **)&batch->highRef, capacity, sizeof(int)) ||
+      !GrowArray((void **)&batch->cellLowRef, capacity, sizeof(int)) ||
+      !GrowArray((void **)&batch->cellHighRef, capacity, sizeof(int)) ||
+      !GrowArray((void **)&batch->subtreeEnd, capacity, sizeof(int)))
+    return false;
+  batch->slotCapacity = capacity;
+  return true;
+}
+
+static bool ReserveTrees(KDBatch *batch, int trees) {
+  if (trees <= batch->treeCapacity)
+    return true;
+  int capacity = batch->treeCapacity ? batch->treeCapacity * 2 : 16;
+  if (!GrowArray((void **)&batch->progress, capacity, sizeof(float)) ||
+      !GrowArray((void **)&batch->eased, capacity, sizeof(float)) ||
+      !GrowArray((void **)&batch->slotOffset, capacity, sizeof(int)) ||
+      !GrowArray((void **)&batch->nodeCount, capacity, sizeof(int)))
+    return false;
+  batch->treeCapacity = capacity;
+  return true;
+}
+
+static void SetBoundSlot(KDBatch *batch, int slot, float value) {
+  batch->originSplit[slot] = batch->targetSplit[slot] = value;
+  batch->split[slot] = value;
+  batch->axis[slot] = KD_BATCH_BOUND;
+  batch->lowRef[slot] = batch->highRef[slot] = slot;
+  batch->cellLowRef[slot] = batch->cellHighRef[slot] = slot;
+  batch->subtreeEnd[slot] = slot + 1;
+}
+
+// Axis, segment and cell references of `node` and its subtree. KDTree2f
+// numbers nodes in preorder like the slots, so node i lives in slot
+// `first + i`. Returns the slot after the subtree.
+static int LinkNodes(KDBatch *batch, const KDTree2f *tree, int node,
+                      int first, int xMinRef, int yMinRef, int xMaxRef,
+                      int yMaxRef) {
+  if (node < 0)
+    return -1;
+
+  const KDTree2fNode *n = &tree->nodes[node];
+  int slot = first + node;
+  int left, right;
+  batch->axis[slot] = (unsigned char)n->axis;
+  if (n->axis == 0) {
+    batch->lowRef[slot] = yMinRef;
+    batch->highRef[slot] = yMaxRef;
+    batch->cellLowRef[slot] = xMinRef;
+    batch->cellHighRef[slot] = xMaxRef;
+    left =
+        LinkNodes(batch, tree, n->left, first, xMinRef, yMinRef, slot, yMaxRef);
+    right = LinkNodes(batch, tree, n->right, first, slot, yMinRef, xMaxRef,
+                      yMaxRef);
+  } else {
+    batch->lowRef[slot] = xMinRef;
+    batch->highRef[slot] = xMaxRef;
+    batch->cellLowRef[slot] = yMinRef;
+    batch->cellHighRef[slot] = yMaxRef;
+    left =
+        LinkNodes(batch, tree, n->left, first, xMinRef, yMinRef, xMaxRef, slot);
+    right = LinkNodes(batch, tree, n->right, first, xMinRef, slot, xMaxRef,
+                      yMaxRef);
+  }
+  int end = right >= 0 ? right : (left >= 0 ? left : slot + 1);
+  batch->subtreeEnd[slot] = end;
+  return end;
+}
+
+// Median topology only depends on the count, so the origin and target trees
+// share one preorder and their medians pair by rank exactly like
+// buildKDTree. Building each side with the other as its "target" at
+// interpolation 0 keeps the split coordinates exact.
+static bool FlattenTree(KDBatch *batch, int tree, Vector2 *origin,
+                        Vector2 *target, int count, int depth,
+                        Rectangle bounds) {
+  KDTree2f from = {0};
+  KDTree2f to = {0};
+  if (!KDTree2fBuild(&from, KDTree2fFromVector2(origin),
+                     KDTree2fFromVector2(target), count, depth, 0.0f) ||
+      !KDTree2fBuild(&to, KDTree2fFromVector2(target),
+                     KDTree2fFromVector2(origin), count, depth, 0.0f)) {
+    KDTree2fFree(&from);
+    KDTree2fFree(&to);
+    return false;
+  }
+
+  int offset = batch->slotOffset[tree];
+  SetBoundSlot(batch, offset + 0, bounds.x);
+  SetBoundSlot(batch, offset + 1, bounds.y);
+  SetBoundSlot(batch, offset + 2, bounds.x + bounds.width);
+  SetBoundSlot(batch, offset + 3, bounds.y + bounds.height);
+  int first = offset + 4;
+  for (int i = 0; i < count; i++) {
+    int axis = from.nodes[i].axis;
+    batch->originSplit[first + i] = from.nodes[i].point.v[axis];
+    batch->targetSplit[first + i] = to.nodes[i].point.v[axis];
+    batch->split[first + i] = batch->originSplit[first + i];
+  }
+  LinkNodes(batch, &from, count > 0 ? 0 : -1, first, offset + 0, offset + 1,
+            offset + 2, offset + 3);
+  batch->progress[tree] = 0.0f;
+  batch->eased[tree] = 0.0f;
+  KDTree2fFree(&from);
+  KDTree2fFree(&to);
+  return true;
+}
+
+int AddKDBatchTree(KDBatch *batch, Vector2 *origin, Vector2 *target,
+                   int count, int depth, Rectangle bounds) {
+  if (!ReserveTrees(batch, batch->treeCount + 1) ||
+      !ReserveSlots(batch, batch->slotCount + 4 + count))
+    return -1;
+
+  int tree = batch->treeCount++;
+  batch->slotOffset[tree] = batch->slotCount;
+  batch->nodeCount[tree] = count;
+  batch->slotCount += 4 + count;
+  if (!FlattenTree(batch, tree, origin, target, count, depth, bounds)) {
+    batch->treeCount--;
+    batch->slotCount -= 4 + count;
+    return -1;
+  }
+  return tree;
+}
+
+bool SetKDBatchTreePoints(KDBatch *batch, int tree, Vector2 *origin,
+                          Vector2 *target, int count, int depth) {
+  if (tree < 0 || tree >= batch->treeCount || batch->nodeCount[tree] != count)
+    return false;
+
+  int offset = batch->slotOffset[tree];
+  Rectangle bounds = {batch->originSplit[offset + 0],
+                      batch->originSplit[offset + 1],
+                      batch->originSplit[offset + 2] - batch->originSplit[offset + 0],
+                      batch->originSplit[offset + 3] - batch->originSplit[offset + 1]};
+  return FlattenTree(batch, tree, origin, target, count, depth, bounds);
+}
+
+void SetKDBatchTreeProgress(KDBatch *batch, int tree, float progress) {
+  if (tree < 0 || tree >= batch->treeCount)
+    return;
+  batch->progress[tree] =
+      progress < 0.0f ? 0.0f : (progress > 1.0f ? 1.0f : progress);
+}
+
+// Cubic ease-in-out, the same curve as the game's smootherstep
+static inline float EaseInOutCubic(float t) {
+  float u = 1.0f - t;
+  return t < 0.5f ? 4.0f * t * t * t : 1.0f - 4.0f * u * u * u;
+}
+
+static void UpdateScalar(KDBatch *batch) {
+  for (int tree = 0; tree < batch->treeCount; tree++) {
+    batch->eased[tree] = EaseInOutCubic(batch->progress[tree]);
+  }
+  for (int tree = 0; tree < batch->treeCount; tree++) {
+    float w = batch->eased[tree];
+    int begin = batch->slotOffset[tree];
+    int end = begin + 4 + batch->nodeCount[tree];
+    for (int i = begin; i < end; i++) {
+      float o = batch->originSplit[i];
+      batch->split[i] = o + w * (batch->targetSplit[i] - o);
+    }
+  }
+}
+
+#if KD_HAVE_X86_SIMD
+static void UpdateSSE(KDBatch *batch) {
+  const __m128 half = _mm_set1_ps(0.5f);
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 four = _mm_set1_ps(4.0f);
+  int tree = 0;
+  for (; tree + 4 <= batch->treeCount; tree += 4) {
+    __m128 t = _mm_loadu_ps(batch->progress + tree);
+    __m128 u = _mm_sub_ps(one, t);
+    __m128 in = _mm_mul_ps(four, _mm_mul_ps(t, _mm_mul_ps(t, t)));
+    __m128 out = _mm_sub_ps(one, _mm_mul_ps(four, _mm_mul_ps(u, _mm_mul_ps(u, u))));
+    __m128 mask = _mm_cmplt_ps(t, half);
+    _mm_storeu_ps(batch->eased + tree,
+                  _mm_or_ps(_mm_and_ps(mask, in), _mm_andnot_ps(mask, out)));
+  }
+  for (; tree < batch->treeCount; tree++) {
+    batch->eased[tree] = EaseInOutCubic(batch->progress[tree]);
+  }
+
+  for (tree = 0; tree < batch->treeCount; tree++) {
+    __m128 w = _mm_set1_ps(batch->eased[tree]);
+    int i = batch->slotOffset[tree];
+    int end = i + 4 + batch->nodeCount[tree];
+    for (; i + 4 <= end; i += 4) {
+      __m128 o = _mm_loadu_ps(batch->originSplit + i);
+      __m128 t = _mm_loadu_ps(batch->targetSplit + i);
+      _mm_storeu_ps(batch->split + i,
+                    _mm_add_ps(o, _mm_mul_ps(w, _mm_sub_ps(t, o))));
+    }
+    for (; i < end; i++) {
+      float o = batch->originSplit[i];
+      batch->split[i] = o + batch->eased[tree] * (batch->targetSplit[i] - o);
+    }
+  }
+}
+
+KD_TARGET_AVX2 static void UpdateAVX2(KDBatch *batch) {
+  const __m256 half = _mm256_set1_ps(0.5f);
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 four = _mm256_set1_ps(4.0f);
+  int tree = 0;
+  for (; tree + 8 <= batch->treeCount; tree += 8) {
+    __m256 t = _mm256_loadu_ps(batch->progress + tree);
+    __m256 u = _mm256_sub_ps(one, t);
+    __m256 in = _mm256_mul_ps(four, _mm256_mul_ps(t, _mm256_mul_ps(t, t)));
+    __m256 out = _mm256_fnmadd_ps(four, _mm256_mul_ps(u, _mm256_mul_ps(u, u)), one);
+    __m256 mask = _mm256_cmp_ps(t, half, _CMP_LT_OQ);
+    _mm256_storeu_ps(batch->eased + tree, _mm256_blendv_ps(out, in, mask));
+  }
+  for (; tree < batch->treeCount; tree++) {
+    batch->eased[tree] = EaseInOutCubic(batch->progress[tree]);
+  }
+
+  for (tree = 0; tree < batch->treeCount; tree++) {
+    __m256 w = _mm256_set1_ps(batch->eased[tree]);
+    int i = batch->slotOffset[tree];
+    int end = i + 4 + batch->nodeCount[tree];
+    for (; i + 8 <= end; i += 8) {
+      __m256 o = _mm256_loadu_ps(batch->originSplit + i);
+      __m256 t = _mm256_loadu_ps(batch->targetSplit + i);
+      _mm256_storeu_ps(batch->split + i,
+                       _mm256_fmadd_ps(w, _mm256_sub_ps(t, o), o));
+    }
+    for (; i < end; i++) {
+      float o = batch->originSplit[i];
+      batch->split[i] = o + batch->eased[tree] * (batch->targetSplit[i] - o);
+    }
+  }
+}
+#endif
+
+void UpdateKDBatch(KDBatch *batch) {
+  switch (GetKDSimdLevel()) {
+#if KD_HAVE_X86_SIMD
+  case KD_SIMD_AVX2:
+    UpdateAVX2(batch);
+    break;
+  case KD_SIMD_SSE2:
+    UpdateSSE(batch);
+    break;
+#endif
+  default:
+    UpdateScalar(batch);
+    break;
+  }
+}
+
+int GetKDBatchSegmentCount(const KDBatch *batch) {
+  return batch->slotCount - 4 * batch->treeCount;
+}
+
+int EmitKDBatchSegments(const KDBatch *batch, float minCellPixels,
+                        Vector2 *out, int capacity) {
+  const float *split = batch->split;
+  int written = 0;
+  int i = 0;
+  while (i < batch->slotCount && written < capacity) {
+    unsigned char axis = batch->axis[i];
+    if (axis == KD_BATCH_BOUND) {
+      i++;
+      continue;
+    }
+    float s = split[i];
+    float lo = split[batch->lowRef[i]];
+    float hi = split[batch->highRef[i]];
+    if (hi - lo < minCellPixels ||
+        split[batch->cellHighRef[i]] - split[batch->cellLowRef[i]] <
+            minCellPixels) {
+      i = batch->subtreeEnd[i];
+      continue;
+    }
+    if (axis == 0) {
+      out[2 * written] = (Vector2){s, lo};
+      out[2 * written + 1] = (Vector2){s, hi};
+    } else {
+      out[2 * written] = (Vector2){lo, s};
+      out[2 * written + 1] = (Vector2){hi, s};
+    }
+    written++;
+    i++;
+  }
+  return written;
+}
+
+void JitterKDBatchSplits(KDBatch *batch, float *scratch, float time,
+                         float amplitude) {
+  int count = batch->slotCount;
+  float *x = scratch;
+  float *y = scratch + count;
+  float *noise = scratch + 2 * count;
+  for (int i = 0; i < count; i++) {
+    x[i] = i * 0.61f;
+    y[i] = time;
+  }
+  fractal_simplex2d_batch(x, y, noise, count, 3, 0.5f);
+  for (int i = 0; i < count; i++) {
+    if (batch->axis[i] != KD_BATCH_BOUND)
+      batch->split[i] += amplitude * noise[i];
+  }
+}
@@ -0,0 +1,77 @@
+#ifndef _KD_BATCH
+#define _KD_BATCH
+#include "kd_types.h"
+
+// Many animated kd-trees in one set of structure-of-arrays buffers.
+//
+// Every tree owns a contiguous run of split slots: four fixed slots for its
+// bounds (xMin, yMin, xMax, yMax) followed by one slot per node in preorder.
+// A node's segment spans between two other slots of the same run, so after
+// UpdateKDBatch has interpolated all slots the segments are a plain gather.
+// The topology only depends on the sorted point order, never on the
+// interpolation value, so trees are flattened once per transition instead
+// of once per frame.
+typedef struct KDBatch {
+  // Per slot
+  float *originSplit;   // split coordinate at progress 0
+  float *targetSplit;   // split coordinate at progress 1
+  float *split;         // interpolated, written by UpdateKDBatch
+  unsigned char *axis;  // 0 vertical line, 1 horizontal, KD_BATCH_BOUND
+  int *lowRef;          // slots holding the segment's start and end
+  int *highRef;         // along the other axis
+  int *cellLowRef;      // slots bounding the node's cell along its own axis
+  int *cellHighRef;
+  int *subtreeEnd;      // slot after the node's subtree, for LOD skips
+  int slotCount;
+  int slotCapacity;
+
+  // Per tree
+  float *progress;      // linear animation progress, clamped to [0, 1]
+  float *eased;         // eased progress, written by UpdateKDBatch
+  int *slotOffset;
+  int *nodeCount;
+  int treeCount;
+  int treeCapacity;
+} KDBatch;
+
+#define KD_BATCH_BOUND 0xFF
+
+void InitKDBatch(KDBatch *batch);
+void FreeKDBatch(KDBatch *batch);
+// Drop all trees but keep the buffers for reuse
+void ClearKDBatch(KDBatch *batch);
+// Flatten a tree over `count` origin/target pairs (both reordered in place,
+// like buildKDTree) inside `bounds`, using two KDTree2f builds. `depth` picks
+// the root axis as in buildKDTree. Returns the tree id, or -1 on allocation
+// failure.
+int AddKDBatchTree(KDBatch *batch, Vector2 *origin, Vector2 *target,
+                   int count, int depth, Rectangle bounds);
+// Start a new transition for an existing tree. `count` must match the count
+// it was added with. Progress is reset to 0. Returns false on a count
+// mismatch or allocation failure.
+bool SetKDBatchTreePoints(KDBatch *batch, int tree, Vector2 *origin,
+                          Vector2 *target, int count, int depth);
+void SetKDBatchTreeProgress(KDBatch *batch, int tree, float progress);
+// Ease every tree's progress and interpolate every split slot, using the
+// kernel for GetKDSimdLevel()
+void UpdateKDBatch(KDBatch *batch);
+// Wobble every split slot written by UpdateKDBatch by up to `amplitude`
+// with 3-octave fractal simplex noise over (slot, time). Bound slots stay
+// put. `scratch` must hold 3 * slotCount floats.
+void JitterKDBatchSplits(KDBatch *batch, float *scratch, float time,
+                         float amplitude);
+// Number of segments EmitKDBatchSegments writes with no LOD threshold
+int GetKDBatchSegmentCount(const KDBatch *batch);
+// Write up to `capacity` segments as start/end pairs (2 Vector2 each) and
+// return the number written. Like EmitKDTreeSegments, a node whose cell is
+// thinner than `minCellPixels` is skipped together with its subtree.
+int EmitKDBatchSegments(const KDBatch *batch, float minCellPixels,
+                        Vector2 *out, int capacity);
+#ifndef KDTREE_CORE
+// Draw every tree's segments in one rlgl line batch with the same LOD as
+// DrawKDTreeLOD, optionally shading collapsed cells (game only, see
+// raylib_bridge.c)
+void DrawKDBatch(const KDBatch *batch, float minCellPixels,
+                 bool shadeCollapsed, Color color);
+#endif
+#endif
@@ -0,0 +1,401 @@
+#include "kd_snapshot.h"
+#include "alloc_track.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef _WIN32
+#include <io.h>
+#include <stdlib.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+_Static_assert(sizeof(KDSnapshotHeader) == 32, "snapshot header layout");
+_Static_assert(sizeof(KDSnapshotNode) == 36, "snapshot node layout");
+
+static const char snapshotMagic[8] = {'K', 'D', 'S', 'N', 'A', 'P', 0, 0};
+#define KD_SNAPSHOT_BYTE_ORDER 0x01020304u
+
+static uint32_t Fnv1a(const void *data, size_t size) {
+  const unsigned char *bytes = data;
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static int CountNodes(const TreeNode *node) {
+  if (node == NULL)
+    return 0;
+  return 1 + CountNodes(node->left) + CountNodes(node->right);
+}
+
+static int TreeDepth(const TreeNode *node) {
+  if (node == NULL)
+    return 0;
+  int left = TreeDepth(node->left);
+  int right = TreeDepth(node->right);
+  return 1 + (left > right ? left : right);
+}
+
+// Preorder copy; returns the next free index
+static uint32_t FlattenNode(const TreeNode *node, KDSnapshotNode *nodes,
+                            uint32_t index) {
+  KDSnapshotNode *flat = &nodes[index];
+  *flat = (KDSnapshotNode){
+      .point = node->point,
+      .boundsMin = node->boundsMin,
+      .boundsMax = node->boundsMax,
+      .count = node->count,
+      .dimension = (uint8_t)node->dimension,
+      .flags = node->deleted ? KD_SNAPSHOT_DELETED : 0,
+  };
+  uint32_t next = index + 1;
+  if (node->left) {
+    flat->flags |= KD_SNAPSHOT_HAS_LEFT;
+    next = FlattenNode(node->left, nodes, next);
+  }
+  if (node->right) {
+    flat->flags |= KD_SNAPSHOT_HAS_RIGHT;
+    flat->right = next;
+    next = FlattenNode(node->right, nodes, next);
+  }
+  return next;
+}
+
+#ifdef _WIN32
+static bool SyncFile(FILE *file) { return _commit(_fileno(file)) == 0; }
+
+// rename() does not replace an existing file here; the old snapshot is
+// removed first, so this one step is not atomic
+static bool ReplaceFile(const char *from, const char *to) {
+  remove(to);
+  return rename(from, to) == 0;
+}
+#else
+static bool SyncFile(FILE *file) { return fsync(fileno(file)) == 0; }
+
+static bool ReplaceFile(const char *from, const char *to) {
+  return rename(from, to) == 0;
+}
+#endif
+
+bool WriteKDSnapshot(const TreeNode *root, const char *path) {
+  // LoadKDSnapshot would reject it
+  if (TreeDepth(root) > KD_SNAPSHOT_MAX_DEPTH) {
+    errno = EINVAL;
+    return false;
+  }
+  int nodeCount = CountNodes(root);
+  KDSnapshotNode *nodes = KD_MALLOC(
+      ALLOC_KDTREE, (nodeCount > 0 ? nodeCount : 1) * sizeof(KDSnapshotNode));
+  if (nodes == NULL)
+    return false;
+  if (root != NULL)
+    FlattenNode(root, nodes, 0);
+
+  KDSnapshotHeader header = {
+      .version = KD_SNAPSHOT_VERSION,
+      .byteOrder = KD_SNAPSHOT_BYTE_ORDER,
+      .nodeCount = (uint32_t)nodeCount,
+      .nodeSize = sizeof(KDSnapshotNode),
+      .checksum = Fnv1a(nodes, nodeCount * sizeof(KDSnapshotNode)),
+  };
+  memcpy(header.magic, snapshotMagic, sizeof(header.magic));
+
+  // Write next to the target and rename over it, so a crash or full disk
+  // never leaves a truncated snapshot under `path`
+  size_t pathLength = strlen(path);
+  char *tmpPath = KD_MALLOC(ALLOC_KDTREE, pathLength + sizeof(".tmp"));
+  if (tmpPath == NULL) {
+    KD_FREE(nodes);
+    return false;
+  }
+  memcpy(tmpPath, path, pathLength);
+  memcpy(tmpPath + pathLength, ".tmp", sizeof(".tmp"));
+
+  FILE *file = fopen(tmpPath, "wb");
+  bool ok = file != NULL &&
+            fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(nodes, sizeof(KDSnapshotNode), nodeCount, file) ==
+                (size_t)nodeCount &&
+            fflush(file) == 0 && SyncFile(file);
+  if (file != NULL && fclose(file) != 0)
+    ok = false;
+  if (ok)
+    ok = ReplaceFile(tmpPath, path);
+  if (!ok && file != NULL) {
+    int error = errno;
+    remove(tmpPath);
+    errno = error;
+  }
+  KD_FREE(tmpPath);
+  KD_FREE(nodes);
+  return ok;
+}
+
+#ifdef _WIN32
+// No mmap: read the file into one heap block, queries work the same way
+static void *MapFile(const char *path, size_t *size) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL)
+    return NULL;
+  void *data = NULL;
+  if (fseek(file, 0, SEEK_END) == 0) {
+    long length = ftell(file);
+    if (length > 0 && fseek(file, 0, SEEK_SET) == 0) {
+      data = KD_MALLOC(ALLOC_KDTREE, (size_t)length);
+      if (data != NULL && fread(data, 1, length, file) != (size_t)length) {
+        KD_FREE(data);
+        data = NULL;
+      }
+      *size = (size_t)length;
+    }
+  }
+  fclose(file);
+  return data;
+}
+
+static void UnmapFile(void *data, size_t size) { KD_FREE(data); }
+#else
+static void *MapFile(const char *path, size_t *size) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+  struct stat info;
+  void *data = NULL;
+  if (fstat(fd, &info) == 0 && info.st_size > 0) {
+    data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED)
+      data = NULL;
+    *size = (size_t)info.st_size;
+  }
+  // The mapping keeps the file referenced
+  close(fd);
+  return data;
+}
+
+static void UnmapFile(void *data, size_t size) { munmap(data, size); }
+#endif
+
+// Whether the nodes form exactly one tree in preorder no deeper than
+// KD_SNAPSHOT_MAX_DEPTH: a depth-first walk from node 0 must reach every
+// index once, in order. That makes each right index the end of its left
+// subtree, so no two parents share a child and queries on an unverified
+// file stay in bounds, visit each node once and recurse boundedly. The walk
+// is O(n) and keeps at most one pending entry per level.
+static bool IsPreorderTree(const KDSnapshotNode *nodes, uint32_t count) {
+  uint32_t stackIndex[KD_SNAPSHOT_MAX_DEPTH + 1];
+  int stackDepth[KD_SNAPSHOT_MAX_DEPTH + 1];
+  int top = 0;
+  if (count > 0) {
+    stackIndex[0] = 0;
+    stackDepth[0] = 1;
+    top = 1;
+  }
+  uint32_t expected = 0;
+  while (top > 0) {
+    top--;
+    uint32_t index = stackIndex[top];
+    int depth = stackDepth[top];
+    if (index >= count || index != expected++)
+      return false;
+    const KDSnapshotNode *node = &nodes[index];
+    bool left = node->flags & KD_SNAPSHOT_HAS_LEFT;
+    bool right = node->flags & KD_SNAPSHOT_HAS_RIGHT;
+    if ((left || right) && depth == KD_SNAPSHOT_MAX_DEPTH)
+      return false;
+    // Pending right children of the path plus this node's two children
+    // never exceed one entry per level
+    if (right) {
+      stackIndex[top] = node->right;
+      stackDepth[top++] = depth + 1;
+    }
+    if (left) {
+      stackIndex[top] = index + 1;
+      stackDepth[top++] = depth + 1;
+    }
+  }
+  return expected == count;
+}
+
+bool LoadKDSnapshot(KDSnapshot *snapshot, const char *path,
+                    bool verifyChecksum) {
+  *snapshot = (KDSnapshot){0};
+  errno = 0;
+  size_t size = 0;
+  void *data = MapFile(path, &size);
+  if (data == NULL)
+    return false;
+
+  const KDSnapshotHeader *header = data;
+  bool valid =
+      size >= sizeof(KDSnapshotHeader) &&
+      memcmp(header->magic, snapshotMagic, sizeof(snapshotMagic)) == 0 &&
+      header->version == KD_SNAPSHOT_VERSION &&
+      header->byteOrder == KD_SNAPSHOT_BYTE_ORDER &&
+      header->nodeSize == sizeof(KDSnapshotNode) &&
+      header->nodeCount <= INT32_MAX &&
+      (size - sizeof(KDSnapshotHeader)) / sizeof(KDSnapshotNode) ==
+          header->nodeCount &&
+      (size - sizeof(KDSnapshotHeader)) % sizeof(KDSnapshotNode) == 0;
+  const KDSnapshotNode *nodes =
+      (const KDSnapshotNode *)((const char *)data + sizeof(KDSnapshotHeader));
+  if (valid)
+    valid = IsPreorderTree(nodes, header->nodeCount);
+  if (valid && verifyChecksum)
+    valid = Fnv1a(nodes, header->nodeCount * sizeof(KDSnapshotNode)) ==
+            header->checksum;
+  if (!valid) {
+    UnmapFile(data, size);
+    errno = 0;
+    return false;
+  }
+
+  snapshot->nodes = nodes;
+  snapshot->nodeCount = (int)header->nodeCount;
+  snapshot->mapping = data;
+  snapshot->mappingSize = size;
+  return true;
+}
+
+void UnloadKDSnapshot(KDSnapshot *snapshot) {
+  if (snapshot->mapping != NULL)
+    UnmapFile(snapshot->mapping, snapshot->mappingSize);
+  *snapshot = (KDSnapshot){0};
+}
+
+// Offsets were checked by LoadKDSnapshot
+int KDSnapshotLeftChild(const KDSnapshot *snapshot, int index) {
+  return snapshot->nodes[index].flags & KD_SNAPSHOT_HAS_LEFT ? index + 1 : -1;
+}
+
+int KDSnapshotRightChild(const KDSnapshot *snapshot, int index) {
+  const KDSnapshotNode *node = &snapshot->nodes[index];
+  return node->flags & KD_SNAPSHOT_HAS_RIGHT ? (int)node->right : -1;
+}
+
+static bool PointInRange(Vector2 p, Rectangle range) {
+  return p.x >= range.x && p.x <= range.x + range.width && p.y >= range.y &&
+         p.y <= range.y + range.height;
+}
+
+static int CountSubtree(const KDSnapshot *snapshot, int index,
+                        Rectangle range) {
+  if (index < 0)
+    return 0;
+  const KDSnapshotNode *node = &snapshot->nodes[index];
+
+  if (node->boundsMax.x < range.x ||
+      node->boundsMin.x > range.x + range.width ||
+      node->boundsMax.y < range.y ||
+      node->boundsMin.y > range.y + range.height)
+    return 0;
+  if (PointInRange(node->boundsMin, range) &&
+      PointInRange(node->boundsMax, range))
+    return node->count;
+
+  return (!(node->flags & KD_SNAPSHOT_DELETED) &&
+                  PointInRange(node->point, range)
+              ? 1
+              : 0) +
+         CountSubtree(snapshot, KDSnapshotLeftChild(snapshot, index), range) +
+         CountSubtree(snapshot, KDSnapshotRightChild(snapshot, index), range);
+}
+
+int CountKDSnapshotRange(const KDSnapshot *snapshot, Rectangle range) {
+  return CountSubtree(snapshot, snapshot->nodeCount > 0 ? 0 : -1, range);
+}
+
+static void ReportSubtree(const KDSnapshot *snapshot, int index,
+                          Rectangle range, bool inside, Vector2 *out,
+                          int capacity, int *found) {
+  if (index < 0)
+    return;
+  const KDSnapshotNode *node = &snapshot->nodes[index];
+
+  if (!inside) {
+    if (node->boundsMax.x < range.x ||
+        node->boundsMin.x > range.x + range.width ||
+        node->boundsMax.y < range.y ||
+        node->boundsMin.y > range.y + range.height)
+      return;
+    inside = PointInRange(node->boundsMin, range) &&
+             PointInRange(node->boundsMax, range);
+  }
+
+  if (!(node->flags & KD_SNAPSHOT_DELETED) &&
+      (inside || PointInRange(node->point, range))) {
+    if (*found < capacity)
+      out[*found] = node->point;
+    (*found)++;
+  }
+  ReportSubtree(snapshot, KDSnapshotLeftChild(snapshot, index), range, inside, out,
+                capacity, found);
+  ReportSubtree(snapshot, KDSnapshotRightChild(snapshot, index), range, inside, out,
+                capacity, found);
+}
+
+int ReportKDSnapshotRange(const KDSnapshot *snapshot, Rectangle range,
+                          Vector2 *out, int capacity) {
+  int found = 0;
+  ReportSubtree(snapshot, snapshot->nodeCount > 0 ? 0 : -1, range, false, out,
+                capacity, &found);
+  return found;
+}
+
+// Partition line of node `index` inside `cell`, and the children's cells
+static void SplitCell(const KDSnapshotNode *node, Rectangle cell,
+                      Vector2 *start, Vector2 *end, Rectangle *leftCell,
+                      Rectangle *rightCell) {
+  Vector2 point = node->point;
+  *leftCell = cell;
+  *rightCell = cell;
+  if (node->dimension == 0) {
+    *start = (Vector2){point.x, cell.y};
+    *end = (Vector2){point.x, cell.y + cell.height};
+    leftCell->width = point.x - cell.x;
+    rightCell->x = point.x;
+    rightCell->width = cell.x + cell.width - point.x;
+  } else {
+    *start = (Vector2){cell.x, point.y};
+    *end = (Vector2){cell.x + cell.width, point.y};
+    leftCell->height = point.y - cell.y;
+    rightCell->y = point.y;
+    rightCell->height = cell.y + cell.height - point.y;
+  }
+}
+
+static void EmitSubtree(const KDSnapshot *snapshot, int index, Rectangle cell,
+                        float minCellPixels, Vector2 *out, int capacity,
+                        int *emitted) {
+  if (index < 0 || cell.width < minCellPixels || cell.height < minCellPixels)
+    return;
+
+  Vector2 start, end;
+  Rectangle leftCell, rightCell;
+  SplitCell(&snapshot->nodes[index], cell, &start, &end, &leftCell,
+            &rightCell);
+  if (*emitted < capacity) {
+    out[2 * *emitted] = start;
+    out[2 * *emitted + 1] = end;
+  }
+  (*emitted)++;
+  EmitSubtree(snapshot, KDSnapshotLeftChild(snapshot, index), leftCell, minCellPixels,
+              out, capacity, emitted);
+  EmitSubtree(snapshot, KDSnapshotRightChild(snapshot, index), rightCell, minCellPixels,
+              out, capacity, emitted);
+}
+
+int EmitKDSnapshotSegments(const KDSnapshot *snapshot, Rectangle cell,
+                           float minCellPixels, Vector2 *out, int capacity) {
+  int emitted = 0;
+  EmitSubtree(snapshot, snapshot->nodeCount > 0 ? 0 : -1, cell, minCellPixels,
+              out, capacity, &emitted);
+  return emitted;
+}
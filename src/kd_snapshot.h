@@ -0,0 +1,85 @@
+#ifndef _KD_SNAPSHOT
+#define _KD_SNAPSHOT
+#include "kd_types.h"
+#include "kdtree.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Flat, position-independent snapshot of a built kd-tree.
+//
+// The file is a KDSnapshotHeader followed directly by the nodes in preorder.
+// A node's left child, if any, is the next node; the right child is stored
+// as an index. Nothing holds a pointer, so a snapshot is queried and drawn
+// straight from read-only mapped pages and processes mapping the same file
+// share them. Values are stored in native byte order; the header's
+// byteOrder field rejects files written on the other endianness.
+#define KD_SNAPSHOT_VERSION 1
+// Deepest tree a snapshot may hold, in levels. Far above what any split
+// policy or scapegoat rebuild produces for realistic inputs; it bounds the
+// load-time walk and query recursion on untrusted files.
+#define KD_SNAPSHOT_MAX_DEPTH 1024
+
+typedef struct KDSnapshotHeader {
+  char magic[8];       // "KDSNAP\0\0"
+  uint32_t version;    // KD_SNAPSHOT_VERSION
+  uint32_t byteOrder;  // 0x01020304 as written
+  uint32_t nodeCount;
+  uint32_t nodeSize;   // sizeof(KDSnapshotNode)
+  uint32_t checksum;   // FNV-1a over the node array
+  uint32_t reserved;
+} KDSnapshotHeader;
+
+enum {
+  KD_SNAPSHOT_HAS_LEFT = 1,
+  KD_SNAPSHOT_HAS_RIGHT = 2,
+  KD_SNAPSHOT_DELETED = 4,
+};
+
+typedef struct KDSnapshotNode {
+  Vector2 point;
+  Vector2 boundsMin;  // same subtree metadata as TreeNode
+  Vector2 boundsMax;
+  int32_t count;      // live points in the subtree
+  uint32_t right;     // index of the right child if KD_SNAPSHOT_HAS_RIGHT
+  uint8_t dimension;
+  uint8_t flags;
+  uint16_t reserved;
+} KDSnapshotNode;
+
+typedef struct KDSnapshot {
+  const KDSnapshotNode *nodes;
+  int nodeCount;
+  void *mapping;       // whole file
+  size_t mappingSize;
+} KDSnapshot;
+
+// Write `root` (tombstones included) to `path`.tmp, sync it and rename it
+// over `path`, so readers see the old snapshot or the new one, never a
+// partial file. Returns false on I/O errors, or with errno EINVAL for a tree
+// deeper than KD_SNAPSHOT_MAX_DEPTH, leaving `path` untouched.
+bool WriteKDSnapshot(const TreeNode *root, const char *path);
+// Map `path` read-only. The header, file size and tree structure are always
+// validated in O(n): walked from the root, the nodes must be exactly one
+// preorder tree of at most KD_SNAPSHOT_MAX_DEPTH levels, so queries on the
+// result stay in bounds and visit every node at most once. The checksum is
+// only checked when `verifyChecksum` is set. On failure errno holds the I/O error, or 0 when
+// the file was read but is not a valid snapshot.
+bool LoadKDSnapshot(KDSnapshot *snapshot, const char *path,
+                    bool verifyChecksum);
+void UnloadKDSnapshot(KDSnapshot *snapshot);
+// Index of node `index`'s left or right child, or -1 if it has none
+int KDSnapshotLeftChild(const KDSnapshot *snapshot, int index);
+int KDSnapshotRightChild(const KDSnapshot *snapshot, int index);
+
+// Same results as the TreeNode functions of the same name
+int CountKDSnapshotRange(const KDSnapshot *snapshot, Rectangle range);
+int ReportKDSnapshotRange(const KDSnapshot *snapshot, Rectangle range,
+                          Vector2 *out, int capacity);
+int EmitKDSnapshotSegments(const KDSnapshot *snapshot, Rectangle cell,
+                           float minCellPixels, Vector2 *out, int capacity);
+#ifndef KDTREE_CORE
+// Game only, see raylib_bridge.c
+void DrawKDSnapshot(const KDSnapshot *snapshot, Rectangle cell,
+                    float minCellPixels);
+#endif
+#endif
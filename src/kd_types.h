@@ -0,0 +1,28 @@
+#ifndef _KD_TYPES
+#define _KD_TYPES
+// Plain data types shared by the kd-tree, sampler and friends. The game build
+// takes Vector2/Rectangle from raylib; the raylib-free core library is
+// compiled with KDTREE_CORE and gets layout-compatible definitions instead.
+#ifdef KDTREE_CORE
+#include <stdbool.h>
+typedef struct Vector2 {
+  float x;
+  float y;
+} Vector2;
+typedef struct Rectangle {
+  float x;
+  float y;
+  float width;
+  float height;
+} Rectangle;
+#else
+#include "raylib.h"
+#endif
+
+// 8-bit grayscale image, one byte per pixel in row-major order
+typedef struct GrayImage {
+  unsigned char *data;
+  int width;
+  int height;
+} GrayImage;
+#endif
@@ -1,70 +1,512 @@
 #include "kdtree.h"
-#include "raylib.h"
-#include "raymath.h"
+#include "alloc_track.h"
 #include "simplex.h"
 #include "stddef.h"
+#include <math.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-TreeNode *buildKDTree(Vector2 *origin, Vector2 *target,int count, int depth, TreeNode *parent,
-                      double interpolation) {
-  if (count == 0)
-    return NULL;
+// Scapegoat weight balance factor: a child may hold at most this share of
+// its parent's nodes before the parent gets rebuilt.
+#define KD_BALANCE_ALPHA 0.7
 
-  int dimension = depth % 2;
+static const char *const kSplitPolicyNames[KD_SPLIT_POLICY_COUNT] = {
+    "median", "widest", "midpoint", "cost"};
+
+const char *KDSplitPolicyName(KDSplitPolicy policy) {
+  if (policy < 0 || policy >= KD_SPLIT_POLICY_COUNT)
+    return "unknown";
+  return kSplitPolicyNames[policy];
+}
+
+// Split-axis coordinate of the interpolated point at rank `i`. Once origin
+// and target are both sorted on `dimension` this is non-decreasing in `i`
+// (for interpolation in [0, 1]), so ranks can be searched like a sorted array.
+static inline float LerpedCoord(const Vector2 *origin, const Vector2 *target,
+                                int i, int dimension, float interpolation) {
+  float o = dimension == 0 ? origin[i].x : origin[i].y;
+  float t = dimension == 0 ? target[i].x : target[i].y;
+  return o + interpolation * (t - o);
+}
+
+static void SortOnAxis(Vector2 *origin, Vector2 *target, int count,
+                       int dimension) {
   qsort(origin, count, sizeof(Vector2), dimension == 0 ? CompareX : CompareY);
   qsort(target, count, sizeof(Vector2), dimension == 0 ? CompareX : CompareY);
+}
+
+// Box around the interpolated points without interpolating each of them:
+// per axis, the lerp of the extremes bounds every lerped coordinate.
+static Rectangle LerpedBounds(const Vector2 *origin, const Vector2 *target,
+                              int count, float interpolation) {
+  Vector2 oMin = origin[0], oMax = origin[0];
+  Vector2 tMin = target[0], tMax = target[0];
+  for (int i = 1; i < count; i++) {
+    oMin.x = fminf(oMin.x, origin[i].x);
+    oMin.y = fminf(oMin.y, origin[i].y);
+    oMax.x = fmaxf(oMax.x, origin[i].x);
+    oMax.y = fmaxf(oMax.y, origin[i].y);
+    tMin.x = fminf(tMin.x, target[i].x);
+    tMin.y = fminf(tMin.y, target[i].y);
+    tMax.x = fmaxf(tMax.x, target[i].x);
+    tMax.y = fmaxf(tMax.y, target[i].y);
+  }
+  float xMin = oMin.x + interpolation * (tMin.x - oMin.x);
+  float yMin = oMin.y + interpolation * (tMin.y - oMin.y);
+  float xMax = oMax.x + interpolation * (tMax.x - oMax.x);
+  float yMax = oMax.y + interpolation * (tMax.y - oMax.y);
+  return (Rectangle){xMin, yMin, xMax - xMin, yMax - yMin};
+}
+
+// Rank whose coordinate is closest to `value`; arrays sorted on `dimension`.
+// Falls back to the first or last point when all lie on one side, which is
+// what makes the midpoint "slide" onto the data.
+static int NearestRank(const Vector2 *origin, const Vector2 *target, int count,
+                       int dimension, float interpolation, float value) {
+  int lo = 0;
+  int hi = count;
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (LerpedCoord(origin, target, mid, dimension, interpolation) < value)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo == count)
+    return count - 1;
+  if (lo > 0 &&
+      value - LerpedCoord(origin, target, lo - 1, dimension, interpolation) <
+          LerpedCoord(origin, target, lo, dimension, interpolation) - value)
+    return lo - 1;
+  return lo;
+}
+
+// Expected query cost of splitting `cell` at rank `index`: each side is
+// visited with a probability proportional to its area and costs its count.
+static float SplitCost(Rectangle cell, int dimension, float split, int index,
+                       int count) {
+  float lo = dimension == 0 ? cell.x : cell.y;
+  float extent = dimension == 0 ? cell.width : cell.height;
+  float other = dimension == 0 ? cell.height : cell.width;
+  float leftExtent = fminf(fmaxf(split - lo, 0.0f), extent);
+  return other * (leftExtent * index +
+                  (extent - leftExtent) * (count - index - 1));
+}
+
+// The order builds sort by on `dimension`; updates descend with it too
+static int CompareOnAxis(Vector2 a, Vector2 b, int dimension) {
+  return dimension == 0 ? CompareX(&a, &b) : CompareY(&a, &b);
+}
 
-  // Calculate split index
-  int index = (int)((count)*0.5);
-  index = Clamp(index, 0, count - 1);
-  Vector2 p = Vector2Lerp(origin[index], target[index],interpolation);
+// Reorder `cross` (the points of `axis`, sorted on the other axis) into the
+// points ranked before `index` in `axis`, then axis[index], then the rest,
+// each group keeping its order. One stable pass stands in for sorting both
+// halves again on the other axis.
+static void PartitionCross(const Vector2 *axis, Vector2 *cross, int count,
+                           int index, int dimension, Vector2 *scratch) {
+  Vector2 median = axis[index];
+  // Copies of the median may sit on its left in `axis`; send as many of
+  // them left in `cross`, drop one for the node and send the rest right
+  int equalLeft = 0;
+  for (int i = index - 1;
+       i >= 0 && CompareOnAxis(axis[i], median, dimension) == 0; i--)
+    equalLeft++;
+  bool medianTaken = false;
+  int left = 0;
+  int right = index + 1;
+  for (int i = 0; i < count; i++) {
+    int side = CompareOnAxis(cross[i], median, dimension);
+    if (side == 0) {
+      if (equalLeft > 0) {
+        equalLeft--;
+        side = -1;
+      } else if (!medianTaken) {
+        medianTaken = true;
+        continue;
+      } else {
+        side = 1;
+      }
+    }
+    if (side < 0)
+      scratch[left++] = cross[i];
+    else
+      scratch[right++] = cross[i];
+  }
+  scratch[index] = median;
+  memcpy(cross, scratch, count * sizeof(Vector2));
+}
+
+// Subtree metadata for range queries and incremental updates, once both
+// children of a freshly built node are in place
+static void SetSubtreeMetadata(TreeNode *node, int count) {
+  node->count = count;
+  node->size = count;
+  node->deleted = false;
+  node->boundsMin = node->boundsMax = node->point;
+  if (node->left) {
+    node->boundsMin.x = fminf(node->boundsMin.x, node->left->boundsMin.x);
+    node->boundsMin.y = fminf(node->boundsMin.y, node->left->boundsMin.y);
+    node->boundsMax.x = fmaxf(node->boundsMax.x, node->left->boundsMax.x);
+    node->boundsMax.y = fmaxf(node->boundsMax.y, node->left->boundsMax.y);
+  }
+  if (node->right) {
+    node->boundsMin.x = fminf(node->boundsMin.x, node->right->boundsMin.x);
+    node->boundsMin.y = fminf(node->boundsMin.y, node->right->boundsMin.y);
+    node->boundsMax.x = fmaxf(node->boundsMax.x, node->right->boundsMax.x);
+    node->boundsMax.y = fmaxf(node->boundsMax.y, node->right->boundsMax.y);
+  }
+}
+
+static void SplitCell(Rectangle cell, int dimension, Vector2 split,
+                      Rectangle *left, Rectangle *right) {
+  *left = *right = cell;
+  if (dimension == 0) {
+    left->width = split.x - cell.x;
+    right->x = split.x;
+    right->width = cell.x + cell.width - split.x;
+  } else {
+    left->height = split.y - cell.y;
+    right->y = split.y;
+    right->height = cell.y + cell.height - split.y;
+  }
+}
+
+// Whether both children of a node split at `index` of `count` points were
+// built. If an allocation failed below, the node and whatever was built
+// under it are freed, so a failed build returns NULL without leaking.
+static bool BuiltChildren(TreeNode *node, int index, int count) {
+  if ((node->left != NULL || index == 0) &&
+      (node->right != NULL || count - index - 1 == 0))
+    return true;
+  freeTree(node);
+  return false;
+}
+
+static TreeNode *BuildSubtree(Vector2 *origin, Vector2 *target, int count,
+                              int depth, TreeNode *parent, float interpolation,
+                              const KDBuildOptions *options, Rectangle cell) {
+  if (count == 0)
+    return NULL;
+
+  int dimension;
+  int index;
+  switch (options->policy) {
+  case KD_SPLIT_WIDEST: {
+    Rectangle bounds = LerpedBounds(origin, target, count, interpolation);
+    dimension = bounds.width >= bounds.height ? 0 : 1;
+    SortOnAxis(origin, target, count, dimension);
+    index = count / 2;
+    break;
+  }
+  case KD_SPLIT_SLIDING_MIDPOINT: {
+    dimension = cell.width >= cell.height ? 0 : 1;
+    SortOnAxis(origin, target, count, dimension);
+    float middle = dimension == 0 ? cell.x + cell.width * 0.5f
+                                  : cell.y + cell.height * 0.5f;
+    index =
+        NearestRank(origin, target, count, dimension, interpolation, middle);
+    break;
+  }
+  // KD_SPLIT_COST is built by BuildCostPresorted
+  case KD_SPLIT_MEDIAN:
+  default:
+    dimension = depth % 2;
+    SortOnAxis(origin, target, count, dimension);
+    // Calculate split index
+    index = (int)((count)*0.5);
+    if (index > count - 1)
+      index = count - 1;
+    break;
+  }
+  Vector2 p = {
+      origin[index].x + interpolation * (target[index].x - origin[index].x),
+      origin[index].y + interpolation * (target[index].y - origin[index].y)};
 
   // Create node
-  TreeNode *node = malloc(sizeof(TreeNode));
+  TreeNode *node = KD_MALLOC(ALLOC_KDTREE, sizeof(TreeNode));
+  if (node == NULL)
+    return NULL;
   node->point = p;
   node->dimension = dimension;
   node->parent = parent;
   node->left = node->right = NULL;
 
-  // Recursively build subtrees
-  node->left = buildKDTree(origin,target, index, depth + 1, node, interpolation);
-  node->right = buildKDTree(origin + index + 1,target + index + 1, count - index - 1, depth + 1,
-                            node, interpolation);
+  // Recursively build subtrees, each in its half of the cell
+  Rectangle leftCell, rightCell;
+  SplitCell(cell, dimension, p, &leftCell, &rightCell);
+  node->left = BuildSubtree(origin, target, index, depth + 1, node,
+                            interpolation, options, leftCell);
+  if (node->left != NULL || index == 0)
+    node->right = BuildSubtree(origin + index + 1, target + index + 1,
+                               count - index - 1, depth + 1, node,
+                               interpolation, options, rightCell);
+  if (!BuiltChildren(node, index, count))
+    return NULL;
 
+  SetSubtreeMetadata(node, count);
+  return node;
+}
+
+// KD_SPLIT_COST over origin and target sets that are each sorted on both
+// axes (index 0 by CompareX, 1 by CompareY). Each node evaluates `samples`
+// evenly ranked planes (plus both extremes) per axis straight from the
+// sorted ranks, where the rank is the count left of the plane, then splits
+// the other axis's orders with PartitionCross. Nothing below the root is
+// re-sorted, where the per-node qsorts used to cost O(m log m) each.
+static TreeNode *BuildCostPresorted(Vector2 *origin[2], Vector2 *target[2],
+                                    int count, TreeNode *parent,
+                                    float interpolation, int samples,
+                                    Rectangle cell, Vector2 *scratch) {
+  if (count == 0)
+    return NULL;
+
+  float bestCost = INFINITY;
+  int dimension = 0;
+  int index = count / 2;
+  for (int d = 0; d < 2; d++) {
+    for (int s = 0; s <= samples + 1; s++) {
+      int rank = (int)((long long)s * (count - 1) / (samples + 1));
+      float split = LerpedCoord(origin[d], target[d], rank, d, interpolation);
+      float cost = SplitCost(cell, d, split, rank, count);
+      if (cost < bestCost) {
+        bestCost = cost;
+        dimension = d;
+        index = rank;
+      }
+    }
+  }
+  Vector2 o = origin[dimension][index];
+  Vector2 t = target[dimension][index];
+  PartitionCross(origin[dimension], origin[1 - dimension], count, index,
+                 dimension, scratch);
+  PartitionCross(target[dimension], target[1 - dimension], count, index,
+                 dimension, scratch);
+  Vector2 p = {o.x + interpolation * (t.x - o.x),
+               o.y + interpolation * (t.y - o.y)};
+
+  TreeNode *node = KD_MALLOC(ALLOC_KDTREE, sizeof(TreeNode));
+  if (node == NULL)
+    return NULL;
+  node->point = p;
+  node->dimension = dimension;
+  node->parent = parent;
+  node->left = node->right = NULL;
+
+  Rectangle leftCell, rightCell;
+  SplitCell(cell, dimension, p, &leftCell, &rightCell);
+  node->left = BuildCostPresorted(origin, target, index, node, interpolation,
+                                  samples, leftCell, scratch);
+  if (node->left != NULL || index == 0)
+    node->right = BuildCostPresorted(
+        (Vector2 *[2]){origin[0] + index + 1, origin[1] + index + 1},
+        (Vector2 *[2]){target[0] + index + 1, target[1] + index + 1},
+        count - index - 1, node, interpolation, samples, rightCell, scratch);
+  if (!BuiltChildren(node, index, count))
+    return NULL;
+  SetSubtreeMetadata(node, count);
   return node;
 }
 
-void DrawKDTree(TreeNode *node, int xMin, int yMin, int xMax, int yMax) {
+// Sort copies of both sets on both axes once and run BuildCostPresorted.
+// Returns NULL if the copies cannot be allocated.
+static TreeNode *BuildCostTree(const Vector2 *origin, const Vector2 *target,
+                               int count, TreeNode *parent,
+                               float interpolation, int samples,
+                               Rectangle cell) {
+  size_t bytes = count * sizeof(Vector2);
+  Vector2 *buffer = KD_MALLOC(ALLOC_KDTREE, 5 * bytes);
+  if (buffer == NULL)
+    return NULL;
+  Vector2 *sortedOrigin[2] = {buffer, buffer + count};
+  Vector2 *sortedTarget[2] = {buffer + 2 * count, buffer + 3 * count};
+  for (int d = 0; d < 2; d++) {
+    memcpy(sortedOrigin[d], origin, bytes);
+    memcpy(sortedTarget[d], target, bytes);
+    SortOnAxis(sortedOrigin[d], sortedTarget[d], count, d);
+  }
+  TreeNode *root =
+      BuildCostPresorted(sortedOrigin, sortedTarget, count, parent,
+                         interpolation, samples, cell, buffer + 4 * count);
+  KD_FREE(buffer);
+  return root;
+}
+
+TreeNode *buildKDTreeEx(Vector2 *origin, Vector2 *target, int count, int depth,
+                        TreeNode *parent, double interpolation,
+                        const KDBuildOptions *options) {
+  if (count == 0)
+    return NULL;
+  KDBuildOptions defaults = {.policy = KD_SPLIT_MEDIAN};
+  if (options == NULL)
+    options = &defaults;
+
+  Rectangle cell = options->bounds;
+  if (cell.width <= 0 || cell.height <= 0)
+    cell = LerpedBounds(origin, target, count, (float)interpolation);
+  if (options->policy == KD_SPLIT_COST)
+    return BuildCostTree(origin, target, count, parent, (float)interpolation,
+                         options->costSamples > 0 ? options->costSamples : 16,
+                         cell);
+  return BuildSubtree(origin, target, count, depth, parent,
+                      (float)interpolation, options, cell);
+}
+
+TreeNode *buildKDTree(Vector2 *origin, Vector2 *target,int count, int depth, TreeNode *parent,
+                      double interpolation) {
+  // The median split never looks at the cell, so skip computing the bounds
+  KDBuildOptions options = {.policy = KD_SPLIT_MEDIAN};
+  return BuildSubtree(origin, target, count, depth, parent,
+                      (float)interpolation, &options, (Rectangle){0});
+}
+
+static void AccumulateStats(const TreeNode *node, int depth,
+                            KDTreeStats *stats, long long *depthSum) {
   if (node == NULL)
     return;
+  stats->nodes++;
+  if (depth > stats->depth)
+    stats->depth = depth;
+  if (node->left == NULL && node->right == NULL) {
+    stats->leaves++;
+    *depthSum += depth;
+  }
+  AccumulateStats(node->left, depth + 1, stats, depthSum);
+  AccumulateStats(node->right, depth + 1, stats, depthSum);
+}
 
-  Vector2 point = node->point;
-  Color lineColor = node->dimension == 0 ? RED : RED;
+KDTreeStats GetKDTreeStats(const TreeNode *root) {
+  KDTreeStats stats = {0};
+  long long depthSum = 0;
+  AccumulateStats(root, 1, &stats, &depthSum);
+  if (stats.leaves > 0)
+    stats.meanLeafDepth = (double)depthSum / stats.leaves;
+  return stats;
+}
 
-  // Draw partition line
-  if (node->dimension == 0) {
-    DrawLine(point.x, yMin, point.x, yMax, lineColor);
-  } else {
-    DrawLine(xMin, point.y, xMax, point.y, lineColor);
+static bool PointInRange(Vector2 p, Rectangle range) {
+  return p.x >= range.x && p.x <= range.x + range.width && p.y >= range.y &&
+         p.y <= range.y + range.height;
+}
+
+static int CountSubtree(const TreeNode *node, Rectangle range,
+                        long long *visited) {
+  if (node == NULL)
+    return 0;
+  (*visited)++;
+
+  // Disjoint: nothing below can match
+  if (node->boundsMax.x < range.x || node->boundsMin.x > range.x + range.width ||
+      node->boundsMax.y < range.y || node->boundsMin.y > range.y + range.height)
+    return 0;
+
+  // Fully contained: the whole subtree matches
+  if (PointInRange(node->boundsMin, range) &&
+      PointInRange(node->boundsMax, range))
+    return node->count;
+
+  return (!node->deleted && PointInRange(node->point, range) ? 1 : 0) +
+         CountSubtree(node->left, range, visited) +
+         CountSubtree(node->right, range, visited);
+}
+
+int CountKDTreeRangeEx(const TreeNode *node, Rectangle range,
+                       KDQueryStats *stats) {
+  long long visited = 0;
+  int found = CountSubtree(node, range, &visited);
+  if (stats) {
+    stats->queries++;
+    stats->nodesVisited += visited;
   }
+  return found;
+}
 
-  // Draw subtrees
-  if (node->left) {
-    if (node->dimension == 0) {
-      DrawKDTree(node->left, xMin, yMin, point.x, yMax);
-    } else {
-      DrawKDTree(node->left, xMin, yMin, xMax, point.y);
-    }
+int CountKDTreeRange(const TreeNode *node, Rectangle range) {
+  return CountKDTreeRangeEx(node, range, NULL);
+}
+
+static void ReportSubtree(const TreeNode *node, Rectangle range, bool inside,
+                          Vector2 *out, int capacity, int *found,
+                          long long *visited) {
+  if (node == NULL)
+    return;
+  (*visited)++;
+
+  if (!inside) {
+    if (node->boundsMax.x < range.x ||
+        node->boundsMin.x > range.x + range.width ||
+        node->boundsMax.y < range.y ||
+        node->boundsMin.y > range.y + range.height)
+      return;
+    inside = PointInRange(node->boundsMin, range) &&
+             PointInRange(node->boundsMax, range);
   }
 
-  if (node->right) {
-    if (node->dimension == 0) {
-      DrawKDTree(node->right, point.x, yMin, xMax, yMax);
-    } else {
-      DrawKDTree(node->right, xMin, point.y, xMax, yMax);
-    }
+  if (!node->deleted && (inside || PointInRange(node->point, range))) {
+    if (*found < capacity)
+      out[*found] = node->point;
+    (*found)++;
+  }
+  ReportSubtree(node->left, range, inside, out, capacity, found, visited);
+  ReportSubtree(node->right, range, inside, out, capacity, found, visited);
+}
+
+int ReportKDTreeRangeEx(const TreeNode *node, Rectangle range, Vector2 *out,
+                        int capacity, KDQueryStats *stats) {
+  int found = 0;
+  long long visited = 0;
+  ReportSubtree(node, range, false, out, capacity, &found, &visited);
+  if (stats) {
+    stats->queries++;
+    stats->nodesVisited += visited;
+  }
+  return found;
+}
+
+int ReportKDTreeRange(const TreeNode *node, Rectangle range, Vector2 *out,
+                      int capacity) {
+  return ReportKDTreeRangeEx(node, range, out, capacity, NULL);
+}
+
+static void EmitSubtree(const TreeNode *node, Rectangle cell,
+                        float minCellPixels, Vector2 *out, int capacity,
+                        int *emitted) {
+  if (node == NULL || cell.width < minCellPixels ||
+      cell.height < minCellPixels)
+    return;
+
+  Vector2 point = node->point;
+  Rectangle leftCell = cell;
+  Rectangle rightCell = cell;
+  Vector2 start, end;
+  if (node->dimension == 0) {
+    start = (Vector2){point.x, cell.y};
+    end = (Vector2){point.x, cell.y + cell.height};
+    leftCell.width = point.x - cell.x;
+    rightCell.x = point.x;
+    rightCell.width = cell.x + cell.width - point.x;
+  } else {
+    start = (Vector2){cell.x, point.y};
+    end = (Vector2){cell.x + cell.width, point.y};
+    leftCell.height = point.y - cell.y;
+    rightCell.y = point.y;
+    rightCell.height = cell.y + cell.height - point.y;
+  }
+  if (*emitted < capacity) {
+    out[2 * *emitted] = start;
+    out[2 * *emitted + 1] = end;
   }
+  (*emitted)++;
+  EmitSubtree(node->left, leftCell, minCellPixels, out, capacity, emitted);
+  EmitSubtree(node->right, rightCell, minCellPixels, out, capacity, emitted);
+}
+
+int EmitKDTreeSegments(const TreeNode *node, Rectangle cell,
+                       float minCellPixels, Vector2 *out, int capacity) {
+  int emitted = 0;
+  EmitSubtree(node, cell, minCellPixels, out, capacity, &emitted);
+  return emitted;
 }
 
 void freeTree(TreeNode *node) {
@@ -72,7 +514,217 @@ void freeTree(TreeNode *node) {
     return;
   freeTree(node->left);
   freeTree(node->right);
-  free(node);
+  KD_FREE(node);
+}
+
+// Gather the live points of a subtree and every one of its nodes, so a
+// rebuild can reuse the nodes instead of freeing and allocating them again
+static void CollectSubtree(TreeNode *node, Vector2 *points, int *n,
+                           TreeNode **nodes, int *nodeCount) {
+  if (node == NULL)
+    return;
+  if (!node->deleted)
+    points[(*n)++] = node->point;
+  nodes[(*nodeCount)++] = node;
+  CollectSubtree(node->left, points, n, nodes, nodeCount);
+  CollectSubtree(node->right, points, n, nodes, nodeCount);
+}
+
+// Median build over points already sorted on both axes (sorted[0] by
+// CompareX, sorted[1] by CompareY). Each level splits the other axis's order
+// around the median in one stable pass instead of re-sorting, so m points
+// take O(m log m) rather than buildKDTree's O(m log^2 m). Produces the same
+// tree as buildKDTree(points, points, count, depth, parent, 1.0), with nodes
+// taken from `pool` instead of allocated.
+static TreeNode *BuildPresorted(Vector2 *sorted[2], int count, int depth,
+                                TreeNode *parent, Vector2 *scratch,
+                                TreeNode ***pool) {
+  if (count == 0)
+    return NULL;
+
+  int dimension = depth % 2;
+  Vector2 *axis = sorted[dimension];
+  Vector2 *cross = sorted[1 - dimension];
+  int index = count / 2;
+  Vector2 median = axis[index];
+  PartitionCross(axis, cross, count, index, dimension, scratch);
+
+  TreeNode *node = *(*pool)++;
+  node->point = median;
+  node->dimension = dimension;
+  node->parent = parent;
+  node->left = BuildPresorted((Vector2 *[2]){sorted[0], sorted[1]}, index,
+                              depth + 1, node, scratch, pool);
+  node->right = BuildPresorted(
+      (Vector2 *[2]){sorted[0] + index + 1, sorted[1] + index + 1},
+      count - index - 1, depth + 1, node, scratch, pool);
+  SetSubtreeMetadata(node, count);
+  return node;
+}
+
+// Replace `node` with a balanced subtree over its live points and return the
+// replacement (NULL if nothing is left). Ancestor sizes are fixed up here.
+// If the scratch buffers cannot be allocated the subtree is left as is.
+static TreeNode *RebuildSubtree(TreeNode *node) {
+  TreeNode *parent = node->parent;
+  int removed = node->size - node->count;
+  size_t points = (node->count > 0 ? node->count : 1) * sizeof(Vector2);
+  Vector2 *byX = KD_MALLOC(ALLOC_KDTREE, points);
+  Vector2 *byY = KD_MALLOC(ALLOC_KDTREE, points);
+  Vector2 *scratch = KD_MALLOC(ALLOC_KDTREE, points);
+  TreeNode **nodes = KD_MALLOC(ALLOC_KDTREE, node->size * sizeof(TreeNode *));
+  if (byX == NULL || byY == NULL || scratch == NULL || nodes == NULL) {
+    KD_FREE(byX);
+    KD_FREE(byY);
+    KD_FREE(scratch);
+    KD_FREE(nodes);
+    return node;
+  }
+  int n = 0;
+  int nodeCount = 0;
+  CollectSubtree(node, byX, &n, nodes, &nodeCount);
+  memcpy(byY, byX, n * sizeof(Vector2));
+  qsort(byX, n, sizeof(Vector2), CompareX);
+  qsort(byY, n, sizeof(Vector2), CompareY);
+
+  // Same parity as the old subtree root keeps the axes alternating
+  TreeNode **pool = nodes;
+  TreeNode *rebuilt = BuildPresorted((Vector2 *[2]){byX, byY}, n,
+                                     node->dimension, parent, scratch, &pool);
+  // Nodes left over held deleted points
+  for (TreeNode **spare = pool; spare < nodes + nodeCount; spare++) {
+    KD_FREE(*spare);
+  }
+  KD_FREE(byX);
+  KD_FREE(byY);
+  KD_FREE(scratch);
+  KD_FREE(nodes);
+
+  if (parent != NULL) {
+    if (parent->left == node)
+      parent->left = rebuilt;
+    else
+      parent->right = rebuilt;
+  }
+  for (TreeNode *up = parent; up != NULL; up = up->parent) {
+    up->size -= removed;
+  }
+  return rebuilt;
+}
+
+TreeNode *InsertKDTree(TreeNode *root, Vector2 point) {
+  TreeNode *leaf = KD_MALLOC(ALLOC_KDTREE, sizeof(TreeNode));
+  if (leaf == NULL)
+    return root;
+  leaf->point = point;
+  leaf->left = leaf->right = NULL;
+  leaf->count = leaf->size = 1;
+  leaf->deleted = false;
+  leaf->boundsMin = leaf->boundsMax = point;
+
+  if (root == NULL) {
+    leaf->dimension = 0;
+    leaf->parent = NULL;
+    return leaf;
+  }
+
+  // Descend, growing counts and bounds along the way
+  TreeNode *node = root;
+  int depth = 0;
+  while (true) {
+    node->count++;
+    node->size++;
+    node->boundsMin.x = fminf(node->boundsMin.x, point.x);
+    node->boundsMin.y = fminf(node->boundsMin.y, point.y);
+    node->boundsMax.x = fmaxf(node->boundsMax.x, point.x);
+    node->boundsMax.y = fmaxf(node->boundsMax.y, point.y);
+    depth++;
+
+    TreeNode **child = CompareOnAxis(point, node->point, node->dimension) < 0
+                           ? &node->left
+                           : &node->right;
+    if (*child == NULL) {
+      leaf->dimension = 1 - node->dimension;
+      leaf->parent = node;
+      *child = leaf;
+      break;
+    }
+    node = *child;
+  }
+
+  // Too deep: rebuild the first weight-unbalanced ancestor above the leaf
+  if (depth > log((double)root->size) / log(1.0 / KD_BALANCE_ALPHA)) {
+    TreeNode *scapegoat = NULL;
+    for (TreeNode *up = leaf->parent; up != NULL; up = up->parent) {
+      int leftSize = up->left ? up->left->size : 0;
+      int rightSize = up->right ? up->right->size : 0;
+      if (leftSize > KD_BALANCE_ALPHA * up->size ||
+          rightSize > KD_BALANCE_ALPHA * up->size) {
+        scapegoat = up;
+        break;
+      }
+    }
+    if (scapegoat != NULL) {
+      TreeNode *rebuilt = RebuildSubtree(scapegoat);
+      if (scapegoat == root)
+        root = rebuilt;
+    }
+  }
+  return root;
+}
+
+static TreeNode *FindLiveNode(TreeNode *node, Vector2 point) {
+  if (node == NULL || point.x < node->boundsMin.x ||
+      point.x > node->boundsMax.x || point.y < node->boundsMin.y ||
+      point.y > node->boundsMax.y)
+    return NULL;
+  if (!node->deleted && node->point.x == point.x && node->point.y == point.y)
+    return node;
+
+  // Left holds split coordinates <= the node's, right >= (interpolated
+  // builds order only the split axis), so only a tie needs both sides
+  float key = node->dimension == 0 ? point.x : point.y;
+  float split = node->dimension == 0 ? node->point.x : node->point.y;
+  if (key < split)
+    return FindLiveNode(node->left, point);
+  if (key > split)
+    return FindLiveNode(node->right, point);
+  TreeNode *found = FindLiveNode(node->left, point);
+  return found ? found : FindLiveNode(node->right, point);
+}
+
+TreeNode *DeleteKDTree(TreeNode *root, Vector2 point) {
+  TreeNode *node = FindLiveNode(root, point);
+  if (node == NULL)
+    return root;
+
+  node->deleted = true;
+  for (TreeNode *up = node; up != NULL; up = up->parent) {
+    up->count--;
+  }
+
+  // Mostly tombstones: rebuild everything from the live points
+  if (root->count * 2 < root->size)
+    root = RebuildSubtree(root);
+  return root;
+}
+
+Vector2 *ResamplePoints(const Vector2 *points, int count, int newCount) {
+  if (count <= 0 || newCount <= 0)
+    return NULL;
+
+  Vector2 *resampled =
+      KD_MALLOC(ALLOC_KDTREE, newCount * sizeof(Vector2));
+  if (!resampled)
+    return NULL;
+
+  // Index mapping i -> i*count/newCount keeps every source point when padding
+  // and picks an even stride when shrinking. The order does not matter since
+  // buildKDTree sorts both sets before pairing them.
+  for (int i = 0; i < newCount; i++) {
+    resampled[i] = points[(long long)i * count / newCount];
+  }
+  return resampled;
 }
 
 int CompareX(const void *a, const void *b) {
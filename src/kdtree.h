@@ -1,20 +1,107 @@
 #ifndef _KDTREE
 #define _KDTREE
-#include "raylib.h"
+#include "kd_types.h"
 typedef struct TreeNode {
   Vector2 point;
   int dimension;
+  int count;          // live points in this subtree, including this node
+  int size;           // nodes in this subtree, including deleted ones
+  bool deleted;       // lazily deleted, kept only as a split plane
+  Vector2 boundsMin;  // bounding box of the subtree points (tight after a
+  Vector2 boundsMax;  // build, conservative after inserts and deletes)
   struct TreeNode *left;
   struct TreeNode *right;
   struct TreeNode *parent;
 } TreeNode;
 
+// Returns NULL for no points, or if a node cannot be allocated (nothing is
+// leaked then)
 TreeNode *buildKDTree(Vector2 *origin, Vector2 *target,int count, int depth, TreeNode *parent,
                       double interpolation);
+
+// How buildKDTreeEx picks each node's split axis and point. Every policy
+// still pairs origin and target by rank, so animations stay continuous.
+typedef enum KDSplitPolicy {
+  KD_SPLIT_MEDIAN,           // median on the axis alternating with depth
+  KD_SPLIT_WIDEST,           // median on the axis with the widest spread
+  KD_SPLIT_SLIDING_MIDPOINT, // point nearest the middle of the longer cell
+                             // side; slides onto the data when all points
+                             // lie on one side, so empty space is cut off
+  KD_SPLIT_COST,             // cheapest of sampled planes on both axes, cost
+                             // = sum of side area x side count
+  KD_SPLIT_POLICY_COUNT,
+} KDSplitPolicy;
+
+typedef struct KDBuildOptions {
+  KDSplitPolicy policy;
+  Rectangle bounds; // root cell; zero size uses the bounds of the points
+  int costSamples;  // planes per axis tried by KD_SPLIT_COST, 0 means 16
+} KDBuildOptions;
+
+// buildKDTree with a selectable split policy. `depth` only matters for
+// KD_SPLIT_MEDIAN; NULL options behave like buildKDTree. Inserts, deletes
+// and scapegoat rebuilds keep using median splits.
+TreeNode *buildKDTreeEx(Vector2 *origin, Vector2 *target, int count, int depth,
+                        TreeNode *parent, double interpolation,
+                        const KDBuildOptions *options);
+const char *KDSplitPolicyName(KDSplitPolicy policy);
+
+typedef struct KDTreeStats {
+  int nodes;
+  int leaves;
+  int depth;            // levels on the longest root-to-leaf path
+  double meanLeafDepth;
+} KDTreeStats;
+KDTreeStats GetKDTreeStats(const TreeNode *root);
+
+// Accumulated by the *Ex queries, so one struct can average many queries
+typedef struct KDQueryStats {
+  long long queries;
+  long long nodesVisited;
+} KDQueryStats;
 void freeTree(TreeNode *node);
+// Insert a point and return the (possibly new) root. Whenever the new leaf
+// ends up deeper than log_{1/a}(size) the nearest a-weight-unbalanced
+// ancestor (scapegoat) is rebuilt, giving O(log^2 n) amortized updates.
+// If the leaf cannot be allocated the tree is returned unchanged.
+TreeNode *InsertKDTree(TreeNode *root, Vector2 point);
+// Lazily delete one live node equal to `point` and return the (possibly new)
+// root. The whole tree is rebuilt once half of its nodes are deleted.
+TreeNode *DeleteKDTree(TreeNode *root, Vector2 point);
+#ifndef KDTREE_CORE
+// Drawing is game only, see raylib_bridge.c
 void DrawKDTree(TreeNode *node, int xMin, int yMin, int xMax, int yMax);
+// DrawKDTree that stops descending once either side of a cell is smaller
+// than `minCellPixels`. Collapsed cells are optionally filled with
+// RED faded by how densely their lines would have covered them.
+void DrawKDTreeLOD(const TreeNode *node, Rectangle cell, float minCellPixels,
+                   bool shadeCollapsed);
+#endif
+// The partition lines DrawKDTreeLOD would draw, without raylib: up to
+// `capacity` segments are written to `out` as start/end pairs (2 Vector2
+// each). Returns the total number of segments, which may exceed `capacity`.
+int EmitKDTreeSegments(const TreeNode *node, Rectangle cell,
+                       float minCellPixels, Vector2 *out, int capacity);
 // void RebuildTree(TreeNode *tree, Vector2 *points, int pointCount,
 //                  double interpolation);
+// Number of tree points inside `range` (edges inclusive). Subtrees whose
+// bounding box lies fully inside the range are counted in O(1).
+int CountKDTreeRange(const TreeNode *node, Rectangle range);
+// Write up to `capacity` tree points inside `range` to `out`. Returns the
+// total number of points in range, which may exceed `capacity`.
+int ReportKDTreeRange(const TreeNode *node, Rectangle range, Vector2 *out,
+                      int capacity);
+// Range queries that also add their visited node count to `stats` (may be
+// NULL)
+int CountKDTreeRangeEx(const TreeNode *node, Rectangle range,
+                       KDQueryStats *stats);
+int ReportKDTreeRangeEx(const TreeNode *node, Rectangle range, Vector2 *out,
+                        int capacity, KDQueryStats *stats);
+// Resample `count` points to exactly `newCount` points (evenly strided
+// subsampling when shrinking, evenly spread duplicates when padding) so an
+// origin and target set of different sizes can be paired by buildKDTree.
+// Returns a malloc'd array, or NULL when `count` or `newCount` is not positive.
+Vector2 *ResamplePoints(const Vector2 *points, int count, int newCount);
 int CompareX(const void *a, const void *b);
 int CompareY(const void *a, const void *b);
 #endif
\ No newline at end of file
@@ -0,0 +1,198 @@
+#ifndef _KDTREE_GENERIC
+#define _KDTREE_GENERIC
+// Macro-generated kd-trees with the dimension count and scalar type fixed at
+// compile time.
+//
+//   KDTREE_GENERIC_DECLARE(Name, T, D)  types, prototypes and inline kernels
+//   KDTREE_GENERIC_DEFINE(Name, T, D)   build / query implementation, once
+//
+// D must be a literal 1..4: every per-dimension operation is spelled out by
+// KD_UNROLL, so comparisons, lerp and distance contain no dimension loops.
+// Unlike buildKDTree, nodes live in one preorder array and each level is
+// split with a quickselect instead of two full qsorts, so building is
+// O(n log n) and a whole tree is a single allocation.
+#include "alloc_track.h"
+#include <stdbool.h>
+
+#define KD_CAT_(a, b) a##b
+#define KD_CAT(a, b) KD_CAT_(a, b)
+
+#define KD_UNROLL_1(M) M(0)
+#define KD_UNROLL_2(M) M(0) M(1)
+#define KD_UNROLL_3(M) M(0) M(1) M(2)
+#define KD_UNROLL_4(M) M(0) M(1) M(2) M(3)
+#define KD_UNROLL(D, M) KD_CAT(KD_UNROLL_, D)(M)
+
+// Per-axis statements; they refer to the local names used by the kernels
+#define KD_LERP_AXIS(i) out.v[i] = a.v[i] + t * (b.v[i] - a.v[i]);
+#define KD_DIST_AXIS(i) d = a.v[i] - b.v[i]; sum += d * d;
+#define KD_TIE_AXIS(i)                                                         \
+  if (a->v[i] < b->v[i])                                                       \
+    return -1;                                                                 \
+  if (a->v[i] > b->v[i])                                                       \
+    return 1;
+
+#define KDTREE_GENERIC_DECLARE(Name, T, D)                                     \
+  typedef struct Name##Point {                                                 \
+    T v[D];                                                                    \
+  } Name##Point;                                                               \
+                                                                               \
+  typedef struct Name##Node {                                                  \
+    Name##Point point;                                                         \
+    int left;  /* child index, -1 if none */                                   \
+    int right;                                                                 \
+    int axis;                                                                  \
+  } Name##Node;                                                                \
+                                                                               \
+  typedef struct Name {                                                        \
+    Name##Node *nodes; /* preorder, nodes[0] is the root */                    \
+    int count;                                                                 \
+  } Name;                                                                      \
+                                                                               \
+  static inline Name##Point Name##Lerp(Name##Point a, Name##Point b, T t) {    \
+    Name##Point out;                                                           \
+    KD_UNROLL(D, KD_LERP_AXIS)                                                 \
+    return out;                                                                \
+  }                                                                            \
+                                                                               \
+  static inline T Name##Distance2(Name##Point a, Name##Point b) {              \
+    T sum = 0;                                                                 \
+    T d;                                                                       \
+    KD_UNROLL(D, KD_DIST_AXIS)                                                 \
+    return sum;                                                                \
+  }                                                                            \
+                                                                               \
+  /* Order on `axis`, ties broken by the full point like CompareX/Y */         \
+  static inline int Name##CompareAxis(const Name##Point *a,                    \
+                                      const Name##Point *b, int axis) {        \
+    if (a->v[axis] < b->v[axis])                                               \
+      return -1;                                                               \
+    if (a->v[axis] > b->v[axis])                                               \
+      return 1;                                                                \
+    KD_UNROLL(D, KD_TIE_AXIS)                                                  \
+    return 0;                                                                  \
+  }                                                                            \
+                                                                               \
+  /* Pair origin/target by rank and interpolate, like buildKDTree. Both    */  \
+  /* arrays are reordered in place. `depth` picks the root axis. `tree`    */  \
+  /* must be zero-initialized or built before; old nodes are freed.        */  \
+  bool Name##Build(Name *tree, Name##Point *origin, Name##Point *target,       \
+                   int count, int depth, T interpolation);                     \
+  void Name##Free(Name *tree);                                                 \
+  /* Index of the node closest to `query`, or -1 for an empty tree */          \
+  int Name##Nearest(const Name *tree, Name##Point query, T *outDistance2);
+
+#define KDTREE_GENERIC_DEFINE(Name, T, D)                                      \
+  static inline void Name##Swap(Name##Point *a, Name##Point *b) {              \
+    Name##Point tmp = *a;                                                      \
+    *a = *b;                                                                   \
+    *b = tmp;                                                                  \
+  }                                                                            \
+                                                                               \
+  /* Put the k-th smallest on `axis` at p[k], smaller before, larger after */  \
+  static void Name##Select(Name##Point *p, int count, int k, int axis) {       \
+    int lo = 0;                                                                \
+    int hi = count - 1;                                                        \
+    while (hi > lo) {                                                          \
+      int mid = lo + (hi - lo) / 2;                                            \
+      if (Name##CompareAxis(&p[mid], &p[lo], axis) < 0)                        \
+        Name##Swap(&p[mid], &p[lo]);                                           \
+      if (Name##CompareAxis(&p[hi], &p[lo], axis) < 0)                         \
+        Name##Swap(&p[hi], &p[lo]);                                            \
+      if (Name##CompareAxis(&p[hi], &p[mid], axis) < 0)                        \
+        Name##Swap(&p[hi], &p[mid]);                                           \
+      Name##Point pivot = p[mid];                                              \
+      int i = lo;                                                              \
+      int j = hi;                                                              \
+      while (i <= j) {                                                         \
+        while (Name##CompareAxis(&p[i], &pivot, axis) < 0)                     \
+          i++;                                                                 \
+        while (Name##CompareAxis(&pivot, &p[j], axis) < 0)                     \
+          j--;                                                                 \
+        if (i <= j) {                                                          \
+          Name##Swap(&p[i], &p[j]);                                            \
+          i++;                                                                 \
+          j--;                                                                 \
+        }                                                                      \
+      }                                                                        \
+      if (k <= j)                                                              \
+        hi = j;                                                                \
+      else if (k >= i)                                                         \
+        lo = i;                                                                \
+      else                                                                     \
+        return;                                                                \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  static int Name##BuildNodes(Name *tree, Name##Point *origin,                 \
+                              Name##Point *target, int count, int depth,       \
+                              T interpolation) {                               \
+    if (count == 0)                                                            \
+      return -1;                                                               \
+    int axis = depth % D;                                                      \
+    int index = count / 2;                                                     \
+    Name##Select(origin, count, index, axis);                                  \
+    Name##Select(target, count, index, axis);                                  \
+                                                                               \
+    int node = tree->count++;                                                  \
+    tree->nodes[node].point =                                                  \
+        Name##Lerp(origin[index], target[index], interpolation);               \
+    tree->nodes[node].axis = axis;                                             \
+    int left = Name##BuildNodes(tree, origin, target, index, depth + 1,        \
+                                interpolation);                                \
+    int right = Name##BuildNodes(tree, origin + index + 1,                     \
+                                 target + index + 1, count - index - 1,        \
+                                 depth + 1, interpolation);                    \
+    tree->nodes[node].left = left;                                             \
+    tree->nodes[node].right = right;                                           \
+    return node;                                                               \
+  }                                                                            \
+                                                                               \
+  bool Name##Build(Name *tree, Name##Point *origin, Name##Point *target,       \
+                   int count, int depth, T interpolation) {                    \
+    KD_FREE(tree->nodes);                                                      \
+    tree->count = 0;                                                           \
+    tree->nodes = count > 0 ? KD_MALLOC(ALLOC_KDTREE,                          \
+                                        count * sizeof(Name##Node))            \
+                            : NULL;                                            \
+    if (count > 0 && tree->nodes == NULL)                                      \
+      return false;                                                            \
+    Name##BuildNodes(tree, origin, target, count, depth, interpolation);       \
+    return true;                                                               \
+  }                                                                            \
+                                                                               \
+  void Name##Free(Name *tree) {                                                \
+    KD_FREE(tree->nodes);                                                      \
+    tree->nodes = NULL;                                                        \
+    tree->count = 0;                                                           \
+  }                                                                            \
+                                                                               \
+  static void Name##NearestFrom(const Name *tree, int node, Name##Point query, \
+                                int *best, T *bestDistance2) {                 \
+    if (node < 0)                                                              \
+      return;                                                                  \
+    const Name##Node *n = &tree->nodes[node];                                  \
+    T d2 = Name##Distance2(n->point, query);                                   \
+    if (*best < 0 || d2 < *bestDistance2) {                                    \
+      *best = node;                                                            \
+      *bestDistance2 = d2;                                                     \
+    }                                                                          \
+    T diff = query.v[n->axis] - n->point.v[n->axis];                           \
+    int nearSide = diff < 0 ? n->left : n->right;                              \
+    int farSide = diff < 0 ? n->right : n->left;                               \
+    Name##NearestFrom(tree, nearSide, query, best, bestDistance2);             \
+    if (diff * diff < *bestDistance2)                                          \
+      Name##NearestFrom(tree, farSide, query, best, bestDistance2);            \
+  }                                                                            \
+                                                                               \
+  int Name##Nearest(const Name *tree, Name##Point query, T *outDistance2) {    \
+    int best = -1;                                                             \
+    T bestDistance2 = 0;                                                       \
+    Name##NearestFrom(tree, tree->count > 0 ? 0 : -1, query, &best,            \
+                      &bestDistance2);                                         \
+    if (outDistance2)                                                          \
+      *outDistance2 = bestDistance2;                                           \
+    return best;                                                               \
+  }
+
+#endif
@@ -0,0 +1,6 @@
+#include "kdtree_instances.h"
+
+KDTREE_GENERIC_DEFINE(KDTree2f, float, 2)
+KDTREE_GENERIC_DEFINE(KDTree3f, float, 3)
+KDTREE_GENERIC_DEFINE(KDTree2d, double, 2)
+KDTREE_GENERIC_DEFINE(KDTree3d, double, 3)
@@ -0,0 +1,44 @@
+#ifndef _KDTREE_INSTANCES
+#define _KDTREE_INSTANCES
+// Concrete specializations of kdtree_generic.h. The KD* macros dispatch on
+// the point or tree type with _Generic so callers don't spell the prefix.
+#include "kd_types.h"
+#include "kdtree_generic.h"
+
+KDTREE_GENERIC_DECLARE(KDTree2f, float, 2)
+KDTREE_GENERIC_DECLARE(KDTree3f, float, 3)
+KDTREE_GENERIC_DECLARE(KDTree2d, double, 2)
+KDTREE_GENERIC_DECLARE(KDTree3d, double, 3)
+
+// Vector2 arrays can be handed to KDTree2f without copying
+_Static_assert(sizeof(KDTree2fPoint) == sizeof(Vector2),
+               "KDTree2fPoint must match Vector2");
+static inline KDTree2fPoint *KDTree2fFromVector2(Vector2 *points) {
+  return (KDTree2fPoint *)points;
+}
+
+#define KDLerp(a, b, t)                                                        \
+  _Generic((a), KDTree2fPoint: KDTree2fLerp, KDTree3fPoint: KDTree3fLerp,      \
+           KDTree2dPoint: KDTree2dLerp, KDTree3dPoint: KDTree3dLerp)(a, b, t)
+
+#define KDDistance2(a, b)                                                      \
+  _Generic((a), KDTree2fPoint: KDTree2fDistance2,                              \
+           KDTree3fPoint: KDTree3fDistance2,                                   \
+           KDTree2dPoint: KDTree2dDistance2,                                   \
+           KDTree3dPoint: KDTree3dDistance2)(a, b)
+
+#define KDBuild(tree, origin, target, count, depth, interpolation)             \
+  _Generic((tree), KDTree2f *: KDTree2fBuild, KDTree3f *: KDTree3fBuild,       \
+           KDTree2d *: KDTree2dBuild, KDTree3d *: KDTree3dBuild)(              \
+      tree, origin, target, count, depth, interpolation)
+
+#define KDFree(tree)                                                           \
+  _Generic((tree), KDTree2f *: KDTree2fFree, KDTree3f *: KDTree3fFree,         \
+           KDTree2d *: KDTree2dFree, KDTree3d *: KDTree3dFree)(tree)
+
+#define KDNearest(tree, query, outDistance2)                                   \
+  _Generic((tree), KDTree2f *: KDTree2fNearest, KDTree3f *: KDTree3fNearest,   \
+           KDTree2d *: KDTree2dNearest, KDTree3d *: KDTree3dNearest)(          \
+      tree, query, outDistance2)
+
+#endif
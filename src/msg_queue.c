@@ -1,10 +1,11 @@
 // msg_queue.c
 #include "msg_queue.h"
+#include "alloc_track.h"
 #include <stdio.h>
 #include <stdlib.h>
 
 int msg_queue_init(MessageQueue *q, int capacity) {
-  q->messages = malloc(sizeof(void *) * capacity);
+  q->messages = KD_MALLOC(ALLOC_PIPELINE, sizeof(void *) * capacity);
   if (!q->messages)
     return -1;
 
@@ -17,7 +18,7 @@ int msg_queue_init(MessageQueue *q, int capacity) {
 }
 
 void msg_queue_destroy(MessageQueue *q) {
-  free(q->messages);
+  KD_FREE(q->messages);
   pthread_mutex_destroy(&q->mutex);
   pthread_cond_destroy(&q->cond_not_empty);
   pthread_cond_destroy(&q->cond_not_full);
@@ -0,0 +1,66 @@
+#include "qpoints.h"
+#include "alloc_track.h"
+#include "cpu_features.h"
+
+QPointSet *AllocQPointSet(int count, Vector2 scale, Vector2 offset) {
+  QPointSet *set = KD_MALLOC(ALLOC_PIPELINE, sizeof(QPointSet));
+  if (set == NULL)
+    return NULL;
+  set->points = KD_MALLOC(ALLOC_PIPELINE,
+                          (count > 0 ? count : 1) * sizeof(QPoint));
+  if (set->points == NULL) {
+    KD_FREE(set);
+    return NULL;
+  }
+  set->count = count;
+  set->scale = scale;
+  set->offset = offset;
+  return set;
+}
+
+void FreeQPointSet(QPointSet *set) {
+  if (set == NULL)
+    return;
+  KD_FREE(set->points);
+  KD_FREE(set);
+}
+
+void DecodeQPoints(const QPointSet *set, Vector2 *out) {
+  const QPoint *q = set->points;
+  int count = set->count;
+  int i = 0;
+#if KD_HAVE_X86_SIMD
+  // 4 points per step: widen 8 uint16 lanes to int32, convert, then one
+  // multiply and add with (sx, sy, sx, sy) / (ox, oy, ox, oy)
+  if (GetKDSimdLevel() >= KD_SIMD_SSE2) {
+    __m128 scale = _mm_setr_ps(set->scale.x, set->scale.y, set->scale.x,
+                               set->scale.y);
+    __m128 offset = _mm_setr_ps(set->offset.x, set->offset.y, set->offset.x,
+                                set->offset.y);
+    __m128i zero = _mm_setzero_si128();
+    for (; i + 4 <= count; i += 4) {
+      __m128i packed = _mm_loadu_si128((const __m128i *)(q + i));
+      __m128 lo = _mm_cvtepi32_ps(_mm_unpacklo_epi16(packed, zero));
+      __m128 hi = _mm_cvtepi32_ps(_mm_unpackhi_epi16(packed, zero));
+      _mm_storeu_ps(&out[i].x, _mm_add_ps(_mm_mul_ps(lo, scale), offset));
+      _mm_storeu_ps(&out[i + 2].x, _mm_add_ps(_mm_mul_ps(hi, scale), offset));
+    }
+  }
+#endif
+  for (; i < count; i++) {
+    out[i].x = set->offset.x + q[i].x * set->scale.x;
+    out[i].y = set->offset.y + q[i].y * set->scale.y;
+  }
+}
+
+QPoint *ResampleQPoints(const QPoint *points, int count, int newCount) {
+  if (count <= 0 || newCount <= 0)
+    return NULL;
+  QPoint *resampled = KD_MALLOC(ALLOC_PIPELINE, newCount * sizeof(QPoint));
+  if (resampled == NULL)
+    return NULL;
+  for (int i = 0; i < newCount; i++) {
+    resampled[i] = points[(long long)i * count / newCount];
+  }
+  return resampled;
+}
@@ -0,0 +1,33 @@
+#ifndef _QPOINTS
+#define _QPOINTS
+#include "kd_types.h"
+#include <stdint.h>
+
+// 16-bit quantized point sets: 4 bytes per point instead of a Vector2's 8.
+// A set decodes as offset + q * scale per axis. Sampler output is already
+// integral pixel coordinates, so it is stored exactly (scale folds in the
+// pixel-to-window factor).
+typedef struct QPoint {
+  uint16_t x;
+  uint16_t y;
+} QPoint;
+
+typedef struct QPointSet {
+  QPoint *points; // owned, KD_MALLOC'd
+  int count;
+  Vector2 scale;
+  Vector2 offset;
+} QPointSet;
+
+// Heap set owning a `count` point buffer, or NULL on allocation failure
+QPointSet *AllocQPointSet(int count, Vector2 scale, Vector2 offset);
+// Frees the set and its points; NULL is ignored
+void FreeQPointSet(QPointSet *set);
+
+// Write the set's `count` decoded points to `out` (SSE2 unless
+// GetKDSimdLevel() is scalar)
+void DecodeQPoints(const QPointSet *set, Vector2 *out);
+// Same index mapping as ResamplePoints, done on the quantized points.
+// Returns a malloc'd array, or NULL when a count is not positive.
+QPoint *ResampleQPoints(const QPoint *points, int count, int newCount);
+#endif
@@ -0,0 +1,232 @@
+// The raylib side of the core modules: drawing trees, snapshots and batches,
+// and baking the glyph atlas from a Font. Compiled into the game only, so
+// kdtree_core itself never needs raylib.
+#include "alloc_track.h"
+#include "glyph_atlas.h"
+#include "kd_batch.h"
+#include "kd_snapshot.h"
+#include "kdtree.h"
+#include "raylib.h"
+#include "rlgl.h"
+#include <math.h>
+#include <string.h>
+
+void DrawKDTree(TreeNode *node, int xMin, int yMin, int xMax, int yMax) {
+  if (node == NULL)
+    return;
+
+  Vector2 point = node->point;
+  Color lineColor = node->dimension == 0 ? RED : RED;
+
+  // Draw partition line
+  if (node->dimension == 0) {
+    DrawLine(point.x, yMin, point.x, yMax, lineColor);
+  } else {
+    DrawLine(xMin, point.y, xMax, point.y, lineColor);
+  }
+
+  // Draw subtrees
+  if (node->left) {
+    if (node->dimension == 0) {
+      DrawKDTree(node->left, xMin, yMin, point.x, yMax);
+    } else {
+      DrawKDTree(node->left, xMin, yMin, xMax, point.y);
+    }
+  }
+
+  if (node->right) {
+    if (node->dimension == 0) {
+      DrawKDTree(node->right, point.x, yMin, xMax, yMax);
+    } else {
+      DrawKDTree(node->right, xMin, point.y, xMax, yMax);
+    }
+  }
+}
+
+// Line ink a fully drawn subtree puts into its cell: about `count` lines of
+// length max(w, h) over w * h pixels, capped at a solid fill.
+static float CellCoverage(int count, float width, float height) {
+  float area = width * height;
+  if (area <= 1.0f)
+    return 1.0f;
+  return fminf(1.0f, count * fmaxf(width, height) / area);
+}
+
+void DrawKDTreeLOD(const TreeNode *node, Rectangle cell, float minCellPixels,
+                   bool shadeCollapsed) {
+  if (node == NULL)
+    return;
+
+  // Too thin to show its partition lines apart from the cell border: stop
+  // here instead of recursing to every leaf. Cells that stay open are at
+  // least minCellPixels square, so cost scales with the window, not the tree
+  if (cell.width < minCellPixels || cell.height < minCellPixels) {
+    if (shadeCollapsed)
+      DrawRectangleRec(cell,
+                       Fade(RED, CellCoverage(node->count, cell.width,
+                                              cell.height)));
+    return;
+  }
+
+  Vector2 point = node->point;
+  Rectangle leftCell = cell;
+  Rectangle rightCell = cell;
+  if (node->dimension == 0) {
+    DrawLineV((Vector2){point.x, cell.y},
+              (Vector2){point.x, cell.y + cell.height}, RED);
+    leftCell.width = point.x - cell.x;
+    rightCell.x = point.x;
+    rightCell.width = cell.x + cell.width - point.x;
+  } else {
+    DrawLineV((Vector2){cell.x, point.y},
+              (Vector2){cell.x + cell.width, point.y}, RED);
+    leftCell.height = point.y - cell.y;
+    rightCell.y = point.y;
+    rightCell.height = cell.y + cell.height - point.y;
+  }
+  DrawKDTreeLOD(node->left, leftCell, minCellPixels, shadeCollapsed);
+  DrawKDTreeLOD(node->right, rightCell, minCellPixels, shadeCollapsed);
+}
+
+static void DrawSnapshotSubtree(const KDSnapshot *snapshot, int index,
+                                Rectangle cell, float minCellPixels) {
+  if (index < 0 || cell.width < minCellPixels || cell.height < minCellPixels)
+    return;
+
+  Vector2 point = snapshot->nodes[index].point;
+  Rectangle leftCell = cell;
+  Rectangle rightCell = cell;
+  if (snapshot->nodes[index].dimension == 0) {
+    DrawLineV((Vector2){point.x, cell.y},
+              (Vector2){point.x, cell.y + cell.height}, RED);
+    leftCell.width = point.x - cell.x;
+    rightCell.x = point.x;
+    rightCell.width = cell.x + cell.width - point.x;
+  } else {
+    DrawLineV((Vector2){cell.x, point.y},
+              (Vector2){cell.x + cell.width, point.y}, RED);
+    leftCell.height = point.y - cell.y;
+    rightCell.y = point.y;
+    rightCell.height = cell.y + cell.height - point.y;
+  }
+  DrawSnapshotSubtree(snapshot, KDSnapshotLeftChild(snapshot, index), leftCell,
+                      minCellPixels);
+  DrawSnapshotSubtree(snapshot, KDSnapshotRightChild(snapshot, index),
+                      rightCell, minCellPixels);
+}
+
+void DrawKDSnapshot(const KDSnapshot *snapshot, Rectangle cell,
+                    float minCellPixels) {
+  DrawSnapshotSubtree(snapshot, snapshot->nodeCount > 0 ? 0 : -1, cell,
+                      minCellPixels);
+}
+
+// Segments per rlBegin/rlEnd block, kept well under the default batch size
+#define KD_BATCH_DRAW_CHUNK 1024
+
+// The cell of node slot `slot`, whose lines DrawKDTreeLOD would skip once
+// it is thinner than `minCellPixels`
+static bool BatchCell(const KDBatch *batch, int slot, float minCellPixels,
+                      Rectangle *cell) {
+  const float *split = batch->split;
+  float lo = split[batch->lowRef[slot]];
+  float hi = split[batch->highRef[slot]];
+  float cellLo = split[batch->cellLowRef[slot]];
+  float cellHi = split[batch->cellHighRef[slot]];
+  if (batch->axis[slot] == 0)
+    *cell = (Rectangle){cellLo, lo, cellHi - cellLo, hi - lo};
+  else
+    *cell = (Rectangle){lo, cellLo, hi - lo, cellHi - cellLo};
+  return cell->width >= minCellPixels && cell->height >= minCellPixels;
+}
+
+void DrawKDBatch(const KDBatch *batch, float minCellPixels,
+                 bool shadeCollapsed, Color color) {
+  const float *split = batch->split;
+  Rectangle cell;
+  int slot = 0;
+  while (slot < batch->slotCount) {
+    rlCheckRenderBatchLimit(2 * KD_BATCH_DRAW_CHUNK);
+    rlBegin(RL_LINES);
+    rlColor4ub(color.r, color.g, color.b, color.a);
+    for (int n = 0; slot < batch->slotCount && n < KD_BATCH_DRAW_CHUNK;) {
+      unsigned char axis = batch->axis[slot];
+      if (axis == KD_BATCH_BOUND) {
+        slot++;
+        continue;
+      }
+      if (!BatchCell(batch, slot, minCellPixels, &cell)) {
+        slot = batch->subtreeEnd[slot];
+        continue;
+      }
+      float s = split[slot];
+      if (axis == 0) {
+        rlVertex2f(s, cell.y);
+        rlVertex2f(s, cell.y + cell.height);
+      } else {
+        rlVertex2f(cell.x, s);
+        rlVertex2f(cell.x + cell.width, s);
+      }
+      n++;
+      slot++;
+    }
+    rlEnd();
+  }
+
+  // Rectangles can't go into the line batch, so collapsed cells get their
+  // own pass
+  if (!shadeCollapsed)
+    return;
+  for (slot = 0; slot < batch->slotCount;) {
+    if (batch->axis[slot] == KD_BATCH_BOUND ||
+        BatchCell(batch, slot, minCellPixels, &cell)) {
+      slot++;
+      continue;
+    }
+    int count = batch->subtreeEnd[slot] - slot;
+    DrawRectangleRec(cell,
+                     Fade(color, CellCoverage(count, cell.width, cell.height)));
+    slot = batch->subtreeEnd[slot];
+  }
+}
+
+bool LoadGlyphAtlas(GlyphAtlas *atlas, Font font, int fontSize, float spacing,
+                    const char *chars) {
+  memset(atlas, 0, sizeof(GlyphAtlas));
+  int count = (int)strlen(chars);
+  if (count > GLYPH_ATLAS_MAX_GLYPHS)
+    count = GLYPH_ATLAS_MAX_GLYPHS;
+
+  // Render each glyph on its own; its image width is its advance
+  Image glyphs[GLYPH_ATLAS_MAX_GLYPHS];
+  for (int i = 0; i < count; i++) {
+    char text[2] = {chars[i], '\0'};
+    glyphs[i] = ImageTextEx(font, text, fontSize, 0, BLACK);
+    atlas->chars[i] = chars[i];
+    atlas->glyphX[i] = atlas->atlasWidth;
+    atlas->glyphWidth[i] = glyphs[i].width;
+    atlas->atlasWidth += glyphs[i].width;
+    if (glyphs[i].height > atlas->atlasHeight)
+      atlas->atlasHeight = glyphs[i].height;
+  }
+  atlas->glyphCount = count;
+  atlas->spacing = spacing;
+
+  atlas->coverage = KD_CALLOC(
+      ALLOC_SAMPLER, (size_t)atlas->atlasWidth * atlas->atlasHeight, 1);
+  bool ok = atlas->coverage != NULL;
+
+  // Keep only the alpha channel, which is the glyph coverage
+  for (int i = 0; i < count; i++) {
+    Color *colors = ok ? LoadImageColors(glyphs[i]) : NULL;
+    for (int y = 0; colors && y < glyphs[i].height; y++) {
+      for (int x = 0; x < glyphs[i].width; x++) {
+        atlas->coverage[y * atlas->atlasWidth + atlas->glyphX[i] + x] =
+            colors[y * glyphs[i].width + x].a;
+      }
+    }
+    UnloadImageColors(colors);
+    UnloadImage(glyphs[i]);
+  }
+  return ok;
+}
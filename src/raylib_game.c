@@ -1,13 +1,17 @@
+#include "alloc_track.h"
 #include "dynamic_array.h"
+#include "glyph_atlas.h"
+#include "kd_batch.h"
 #include "kdtree.h"
 #include "msg_queue.h"
 #include "raylib.h"
 #include "raymath.h"
 #include "reject_sampling.h"
+#include "replay.h"
 #include "simplex.h"
-#include <assert.h>
 #include <math.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -36,43 +40,70 @@ float triangle_wave(float time) {
     return -1.0f + 4.0f * (phase - 0.75f);
   }
 }
-void gen_uniform(DynamicArray *arr, int width, int height, int layers) {
+// Lay out `count` points on a near-square grid of cell centers covering the
+// width x height area. Any count is accepted; the last row is simply left
+// partially filled.
+void gen_grid(DynamicArray *arr, int width, int height, int count) {
   if (arr->element_size != sizeof(Vector2)) {
     fprintf(stderr, "Error: DynamicArray element size mismatch.\n");
     return;
   }
-  for (int current_layer = 0; current_layer < layers; current_layer++) {
-    int box_x_width = width / pow(2, current_layer + 1);
-    printf("box_x_width: %d\n", box_x_width);
-    int box_y_height = height / pow(2, current_layer + 1);
-    int xy_segment_count = pow(2, current_layer);
-    for (int n = 0; n < pow(xy_segment_count, 2); n++) {
-      int x = box_x_width + (n % xy_segment_count) * box_x_width * 2;
-      int y_bias =
-          (box_y_height / 2) + (n / xy_segment_count) * box_y_height * 2;
-      int y1 = y_bias;
-      int y2 = y_bias + (box_y_height / 2);
-      int y3 = y_bias + box_y_height;
-      Vector2 temp1 = (Vector2){.x = (float)x, .y = (float)y1};
-      da_push(arr, &temp1);
-      da_push(arr, &(Vector2){.x = x, .y = y2});
-      da_push(arr, &(Vector2){.x = x, .y = y3});
+  if (count <= 0)
+    return;
+  int cols = (int)ceil(sqrt((double)count * width / height));
+  int rows = (count + cols - 1) / cols;
+  float cell_w = (float)width / cols;
+  float cell_h = (float)height / rows;
+  for (int n = 0; n < count; n++) {
+    Vector2 temp = (Vector2){.x = (n % cols + 0.5f) * cell_w,
+                             .y = (n / cols + 0.5f) * cell_h};
+    da_push(arr, &temp);
+  }
+}
+// Copy sampler output into a quantized set in window coordinates, resampled
+// to exactly `count` points so every set pairs with the current origin set.
+// Takes ownership of `points`. Returns NULL when the sampler produced
+// nothing usable or an allocation failed.
+QPointSet *points_to_qset(Point *points, int num_points, int count) {
+  if (points == NULL || num_points <= 0) {
+    KD_FREE(points);
+    return NULL;
+  }
+  if (num_points != count) {
+    Point *resampled = ResampleQPoints(points, num_points, count);
+    KD_FREE(points);
+    if (resampled == NULL) {
+      fprintf(stderr, "Error: cannot resample %d points to %d\n", num_points,
+              count);
+      return NULL;
     }
+    points = resampled;
+  }
+  // Pixel coordinates stay exact; the 2.5x window scale lives in the set
+  QPointSet *set =
+      AllocQPointSet(count, (Vector2){2.5f, 2.5f}, (Vector2){0.0f, 0.0f});
+  if (set == NULL) {
+    fprintf(stderr, "Error: cannot allocate a %d point set\n", count);
+    KD_FREE(points);
+    return NULL;
   }
-  assert(arr->size == (pow(4, layers) - 1));
+  memcpy(set->points, points, count * sizeof(QPoint));
+  KD_FREE(points);
+  return set;
 }
 typedef struct thread_arg {
   int num_points_grid;
   MessageQueue *queue;
-  Font font;
-  int font_size;
+  const GlyphAtlas *atlas;
+  atomic_bool running;   // cleared by main to stop the producer
+  atomic_bool finished;  // set by the producer once it sent its last buffer
 } thread_arg;
 void *thread_func(void *arg) {
   thread_arg *arg1 = (thread_arg *)arg;
   MessageQueue *queue = arg1->queue;
-  Font font = arg1->font;
-  int font_size = arg1->font_size;
-  while (true) {
+  // Reused every second; the atlas rasterizer never touches raylib state
+  GrayImage img = {KD_MALLOC(ALLOC_PIPELINE, 320 * 320), 320, 320};
+  while (atomic_load(&arg1->running)) {
     static char last_time[4];
 
     usleep(50 * 1000);
@@ -80,25 +111,30 @@ void *thread_func(void *arg) {
     if (strcmp(secs, last_time) == 0) {
       continue;
     }
-    Image *img = create_image_with_font(secs, font, font_size, 320, 320);
+    // Out of memory: skip this second and try again on the next one
+    if (img.data == NULL)
+      img.data = KD_MALLOC(ALLOC_PIPELINE, 320 * 320);
+    if (img.data == NULL)
+      continue;
+    RasterizeGlyphText(arg1->atlas, secs, &img);
     strcpy(last_time, secs);
 
     // Distribute points
-    int num_points, width, height;
-    Point *points = distribute_points_on_image(img, 1023,
-                                               1.0f, // min distance
-                                               &num_points, &width, &height);
-    assert(num_points == arg1->num_points_grid);
-    Vector2 *points_vector2 =
-        (Vector2 *)malloc(arg1->num_points_grid * sizeof(Vector2));
-    printf("Generated %d points on %dx%d image\n", num_points, width, height);
-    for (int i = 0; i < num_points; i++) {
-      points_vector2[i].x = points[i].x * 2.5f;
-      points_vector2[i].y = points[i].y * 2.5f;
-    }
-    msg_queue_send_blocking(queue, points_vector2);
+    int num_points;
+    Point *points = distribute_points_on_gray(&img, arg1->num_points_grid,
+                                              1.0f, // min distance
+                                              &num_points);
+    printf("Generated %d points on %dx%d image\n", num_points, img.width,
+           img.height);
+    QPointSet *set = points_to_qset(points, num_points, arg1->num_points_grid);
+    if (set == NULL)
+      continue;
+    // Ownership of the set passes to the consumer
+    msg_queue_send_blocking(queue, set);
     printf("secs:%s\n", secs);
   }
+  KD_FREE(img.data);
+  atomic_store(&arg1->finished, true);
   return NULL;
 }
 float smootherstep(float edge0, float edge1, float x) {
@@ -116,20 +152,53 @@ float fract(float x) {
   float intpart;
   return modff(x, &intpart);
 }
-int main() {
+// Levels of the tree buildKDTree makes over `count` points
+int median_tree_depth(int count) {
+  int depth = 0;
+  for (; count > 0; count /= 2)
+    depth++;
+  return depth;
+}
+// Default number of points per set; any positive count works, sampler sets
+// that come up short are padded to it
+#define DEFAULT_POINT_COUNT 1023
+// How far J moves a split line at most, in pixels
+#define JITTER_PIXELS 4.0f
+// `--record FILE` captures every point set and frame for tools/kdtree_replay,
+// `--points N` changes the number of points per set
+int main(int argc, char **argv) {
+  const char *record_path = NULL;
+  int point_count = DEFAULT_POINT_COUNT;
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 < argc && strcmp(argv[i], "--record") == 0) {
+      record_path = argv[++i];
+    } else if (i + 1 < argc && strcmp(argv[i], "--points") == 0) {
+      char *end;
+      long value = strtol(argv[++i], &end, 10);
+      if (*end != '\0' || value <= 0 || value > 1 << 24) {
+        fprintf(stderr, "--points must be between 1 and %d\n", 1 << 24);
+        return 2;
+      }
+      point_count = (int)value;
+    } else {
+      fprintf(stderr, "usage: %s [--record FILE] [--points N]\n", argv[0]);
+      return 2;
+    }
+  }
+
   int num_points_grid = 0;
-  int layers = 5; // Number of layers in the KD tree
   MessageQueue queue = {0};
   msg_queue_init(&queue, 1);
-  DynamicArray *arr = da_init(pow(4, layers), sizeof(Vector2));
-  gen_uniform(arr, 800, 800, layers);
+  DynamicArray *arr = da_init(point_count, sizeof(Vector2));
+  gen_grid(arr, 800, 800, point_count);
   Vector2 **generated_vec = (Vector2 **)arr->array;
   num_points_grid = arr->size;
   printf("%d points generated", num_points_grid);
   InitWindow(800, 800, "kd tree");
   SetTargetFPS(60);
 
-  // Load font once in main thread (raylib texture ops not thread-safe)
+  // Load font once in main thread (raylib texture ops not thread-safe) and
+  // bake the digits into a grayscale atlas; the font is not needed after that
   int font_size = 160;
   Font font = GetFontDefault();
   bool font_loaded = false;
@@ -137,48 +206,144 @@ int main() {
     font = LoadFontEx("font.ttf", font_size, NULL, 0);
     font_loaded = true;
   }
+  GlyphAtlas atlas = {0};
+  bool atlas_loaded = LoadGlyphAtlas(&atlas, font, font_size, 2, "0123456789");
+  if (font_loaded)
+    UnloadFont(font);
+  if (!atlas_loaded) {
+    fprintf(stderr, "Error: cannot build the glyph atlas\n");
+    UnloadGlyphAtlas(&atlas);
+    msg_queue_destroy(&queue);
+    da_free(arr);
+    CloseWindow();
+    return 1;
+  }
 
-  Image *img = create_image_with_font(get_current_second(), font, font_size, 320, 320);
+  // Buffers the first set and the frame loop need, before anything starts
+  GrayImage img = {KD_MALLOC(ALLOC_PIPELINE, 320 * 320), 320, 320};
+  Vector2 *points_vector2 =
+      (Vector2 *)KD_MALLOC(ALLOC_PIPELINE, num_points_grid * sizeof(Vector2));
+  Vector2 *origin_points_vector2_ =
+      (Vector2 *)KD_MALLOC(ALLOC_PIPELINE, num_points_grid * sizeof(Vector2));
+  if (img.data == NULL || points_vector2 == NULL ||
+      origin_points_vector2_ == NULL) {
+    fprintf(stderr, "Error: out of memory for %d points\n", num_points_grid);
+    KD_FREE(img.data);
+    KD_FREE(points_vector2);
+    KD_FREE(origin_points_vector2_);
+    UnloadGlyphAtlas(&atlas);
+    msg_queue_destroy(&queue);
+    da_free(arr);
+    CloseWindow();
+    return 1;
+  }
+  RasterizeGlyphText(&atlas, get_current_second(), &img);
 
   // Distribute points
-  int num_points, width, height;
-  Point *points = distribute_points_on_image(img, 1023,
-                                             1.0f, // min distance
-                                             &num_points, &width, &height);
+  int num_points;
+  Point *points = distribute_points_on_gray(&img, num_points_grid,
+                                            1.0f, // min distance
+                                            &num_points);
+  KD_FREE(img.data);
   // Use points...
-  printf("Generated %d points on %dx%d image\n", num_points, width, height);
-  assert(num_points == num_points_grid);
-  Vector2 *points_vector2 =
-      (Vector2 *)malloc(num_points_grid * sizeof(Vector2));
-  for (int i = 0; i < num_points; i++) {
-    points_vector2[i].x = points[i].x * 2.5f;
-    points_vector2[i].y = points[i].y * 2.5f;
+  printf("Generated %d points on %dx%d image\n", num_points, img.width,
+         img.height);
+  QPointSet *first_set = points_to_qset(points, num_points, num_points_grid);
+  if (first_set != NULL) {
+    DecodeQPoints(first_set, points_vector2);
+  } else {
+    // Nothing to morph into yet, start from the grid itself
+    for (int i = 0; i < num_points_grid; i++) {
+      points_vector2[i] = *generated_vec[i];
+    }
   }
   pthread_t thread;
-  thread_arg arg = {.num_points_grid = num_points_grid, .queue = &queue, .font = font, .font_size = font_size};
+  thread_arg arg = {.num_points_grid = num_points_grid, .queue = &queue, .atlas = &atlas};
+  atomic_init(&arg.running, true);
+  atomic_init(&arg.finished, false);
   pthread_create(&thread, NULL, thread_func, &arg);
 
-  Vector2 *origin_points_vector2_ =
-      (Vector2 *)malloc(num_points_grid * sizeof(Vector2));
   for (int i = 0; i < num_points_grid; i++) {
     origin_points_vector2_[i].x = generated_vec[i]->x;
     origin_points_vector2_[i].y = generated_vec[i]->y;
   }
-  simplex1d_init();
+  da_free(arr);
+  ReplayFile recording = {0};
+  if (record_path != NULL) {
+    if (OpenReplayWriter(&recording, record_path, num_points_grid)) {
+      WriteReplayPointSet(&recording, origin_points_vector2_);
+      if (first_set != NULL)
+        WriteReplayQPointSet(&recording, first_set);
+      else
+        WriteReplayPointSet(&recording, points_vector2);
+    } else {
+      fprintf(stderr, "cannot record to %s\n", record_path);
+    }
+  }
+  FreeQPointSet(first_set);
+  // Median splits keep one topology for a whole transition, so that policy
+  // is flattened once per point set and only interpolated per frame
+  KDBatch batch;
+  InitKDBatch(&batch);
+  int batch_tree =
+      AddKDBatchTree(&batch, origin_points_vector2_, points_vector2,
+                     num_points_grid, 1, (Rectangle){0, 0, 800, 800});
+  // Whether the batch holds the transition currently on screen
+  bool batch_current = batch_tree >= 0;
+  // Seeded explicitly so a recording can reproduce the jitter noise
+  unsigned noise_seed = (unsigned)time(NULL);
+  simplex1d_init_seed(noise_seed);
+  if (recording.file != NULL)
+    WriteReplayNoiseSeed(&recording, noise_seed);
+  // Noise scratch for JitterKDBatchSplits, sized for the batch's slots
+  int slot_count = batch_tree >= 0 ? batch.slotCount : 0;
+  float *noise_scratch =
+      KD_MALLOC(ALLOC_PIPELINE, (3 * slot_count + 1) * sizeof(float));
+  if (noise_scratch == NULL)
+    slot_count = 0;
   bool animation_finished = false;
   float last_draw_secs = GetTime();
+  // S cycles the split policy, L toggles shading of sub-pixel cells, J
+  // toggles the noise wobble of median split lines
+  KDBuildOptions build_options = {.policy = KD_SPLIT_MEDIAN,
+                                  .bounds = {0, 0, 800, 800}};
+  bool shade_collapsed = false;
+  bool jitter_splits = false;
+  // HUD depth, only recomputed when the tree's shape can change: a new set,
+  // a policy switch or the end of a transition
+  int hud_depth = 0;
+  bool hud_stale = true;
+  double last_report_secs = GetTime();
   while (!WindowShouldClose()) {
+    if (AllocTrackingEnabled() && GetTime() - last_report_secs >= 10.0) {
+      ReportAllocStats(stdout);
+      last_report_secs = GetTime();
+    }
 
     BeginDrawing();
     ClearBackground(WHITE);
     if (animation_finished) {
-      Vector2 *temp = msg_queue_recv_nonblocking(&queue);
-      if (temp != NULL) {
-        free(origin_points_vector2_);
+      QPointSet *set = msg_queue_recv_nonblocking(&queue);
+      if (set != NULL) {
+        // The old origin's buffer is free again; decode the new target there
+        Vector2 *spare = origin_points_vector2_;
         origin_points_vector2_ = points_vector2;
-        points_vector2 = temp;
+        points_vector2 = spare;
+        DecodeQPoints(set, points_vector2);
+        if (recording.file != NULL)
+          WriteReplayQPointSet(&recording, set);
+        FreeQPointSet(set);
+        // If the batch cannot be re-flattened it still holds the previous
+        // transition, so this one is drawn with per-frame builds instead
+        batch_current =
+            batch_tree >= 0 &&
+            SetKDBatchTreePoints(&batch, batch_tree, origin_points_vector2_,
+                                 points_vector2, num_points_grid, 1);
+        if (batch_tree >= 0 && !batch_current)
+          fprintf(stderr, "Error: cannot flatten the new point set\n");
         last_draw_secs = GetTime();
         animation_finished = false;
+        hud_stale = true;
       }
     }
     double time_secs_delta = GetTime() - last_draw_secs;
@@ -187,18 +352,89 @@ int main() {
     if (animation_finished) {
       interpo = 1.0;
     }
+    if (IsKeyPressed(KEY_S)) {
+      build_options.policy =
+          (KDSplitPolicy)((build_options.policy + 1) % KD_SPLIT_POLICY_COUNT);
+      hud_stale = true;
+    }
+    if (IsKeyPressed(KEY_L)) {
+      shade_collapsed = !shade_collapsed;
+    }
+    if (IsKeyPressed(KEY_J)) {
+      jitter_splits = !jitter_splits;
+    }
     int fps = GetFPS();
     const char *fps_s = TextFormat("FPS:%d", fps);
     DrawText(fps_s, 0, 0, 10, RED);
     if (interpo >= 0.99) {
+      if (!animation_finished)
+        hud_stale = true;
       animation_finished = true;
       interpo = 1.0;
       last_draw_secs = GetTime();
     }
-    TreeNode *tree = buildKDTree(origin_points_vector2_, points_vector2,
-                                 num_points_grid, 1, NULL, interpo);
-    DrawKDTree(tree, 0, 0, 800, 800);
+    bool batch_frame =
+        build_options.policy == KD_SPLIT_MEDIAN && batch_current;
+    // The batch applies the same easing, so it gets the linear progress
+    float progress = animation_finished ? 1.0f : (float)time_secs_delta;
+    bool jitter =
+        batch_frame && jitter_splits && slot_count == batch.slotCount;
+    float jitter_time = (float)GetTime();
+    if (recording.file != NULL)
+      WriteReplayFrame(&recording, (float)interpo, build_options.policy,
+                       batch_frame ? progress : -1.0f,
+                       jitter ? jitter_time : -1.0f);
+    if (batch_frame) {
+      SetKDBatchTreeProgress(&batch, batch_tree, progress);
+      UpdateKDBatch(&batch);
+      if (jitter)
+        JitterKDBatchSplits(&batch, noise_scratch, jitter_time,
+                            JITTER_PIXELS);
+      DrawKDBatch(&batch, 2.0f, shade_collapsed, RED);
+      if (hud_stale) {
+        hud_depth = median_tree_depth(num_points_grid);
+        hud_stale = false;
+      }
+    } else {
+      TreeNode *tree =
+          buildKDTreeEx(origin_points_vector2_, points_vector2,
+                        num_points_grid, 1, NULL, interpo, &build_options);
+      // Cells under 2px would only add invisible lines
+      DrawKDTreeLOD(tree, (Rectangle){0, 0, 800, 800}, 2.0f, shade_collapsed);
+      if (hud_stale) {
+        hud_depth = GetKDTreeStats(tree).depth;
+        hud_stale = false;
+      }
+      freeTree(tree);
+    }
+    DrawText(TextFormat("split:%s depth:%d",
+                        KDSplitPolicyName(build_options.policy), hud_depth),
+             0, 12, 10, RED);
     EndDrawing();
-    freeTree(tree);
   }
+
+  // Stop the producer; keep draining so a blocked send can complete
+  atomic_store(&arg.running, false);
+  while (!atomic_load(&arg.finished)) {
+    FreeQPointSet(msg_queue_recv_nonblocking(&queue));
+    usleep(1000);
+  }
+  pthread_join(thread, NULL);
+  FreeQPointSet(msg_queue_recv_nonblocking(&queue));
+
+  KD_FREE(noise_scratch);
+  FreeKDBatch(&batch);
+  KD_FREE(origin_points_vector2_);
+  KD_FREE(points_vector2);
+  if (recording.file != NULL && !CloseReplay(&recording))
+    fprintf(stderr, "recording to %s is incomplete\n", record_path);
+  UnloadGlyphAtlas(&atlas);
+  msg_queue_destroy(&queue);
+  CloseWindow();
+
+  if (AllocTrackingEnabled()) {
+    ReportAllocStats(stdout);
+    ReportOutstandingAllocs(stdout);
+  }
+  return 0;
 }
\ No newline at end of file
@@ -1,98 +1,64 @@
-#include "raylib.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "alloc_track.h"
 #include "reject_sampling.h"
 
-Image *create_image_with_font(const char *text, Font font, int font_size,
-                              int width, int height) {
-  // Create white background image
-  Image image = GenImageColor(width, height, WHITE);
-
-  // Measure text dimensions
-  Vector2 text_size = MeasureTextEx(font, text, font_size, 0);
-  Vector2 position = {(width - text_size.x) / 2, (height - text_size.y) / 2};
-
-  // Draw text in black
-  ImageDrawTextEx(&image, font, text, position, font_size, 2, BLACK);
-
-  // Convert to grayscale
-  ImageFormat(&image, PIXELFORMAT_UNCOMPRESSED_GRAYSCALE);
-
-  Image* image_p = (Image*)malloc(sizeof(Image));
-  *image_p = image;
-  return image_p;
-}
-
-Image *create_image(const char *text, const char *font_path, int width,
-                   int height) {
-  // Create white background image
-  Image image = GenImageColor(width, height, WHITE);
-  Font font = GetFontDefault();
-  bool font_loaded = false;
-  int font_size = 160;
-
-  // Load custom font if available, else use default
-  if (FileExists(font_path)) {
-    font = LoadFontEx(font_path, font_size, NULL, 0);
-    font_loaded = true;
-  }
-
-  // Measure text dimensions
-  Vector2 text_size = MeasureTextEx(font, text, font_size, 0);
-  Vector2 position = {(width - text_size.x) / 2, (height - text_size.y) / 2};
-
-  // Draw text in black
-  ImageDrawTextEx(&image, font, text, position, font_size, 2, BLACK);
-
-  // Convert to grayscale
-  ImageFormat(&image, PIXELFORMAT_UNCOMPRESSED_GRAYSCALE);
-  // ExportImage(image, path);
-
-  // Cleanup resources
-  if (font_loaded)
-    UnloadFont(font);
-  Image* image_p = (Image*)malloc(sizeof(Image));
-  *image_p = image;
-  // UnloadImage(image);
-
-  // Return duplicated path string
-  return image_p;
-}
-
-Point *distribute_points_on_image(Image *img_p, int num_points,
-                                  float min_distance, int *out_num_points,
-                                  int *out_width, int *out_height) {
-  // Initialize output parameters
+Point *distribute_points_on_gray(const GrayImage *img, int num_points,
+                                 float min_distance, int *out_num_points) {
   *out_num_points = 0;
-  *out_width = 0;
-  *out_height = 0;
-
-  // Load image
-  // Image img = LoadImage(image_path);
-  Image img = *img_p;
-  free(img_p);
-  if (!img.data) {
-    fprintf(stderr, "Error: Image empty");
+  if (!img->data || img->width <= 0 || img->height <= 0 || num_points <= 0) {
+    fprintf(stderr, "Error: Image empty\n");
     return NULL;
   }
-
-  // Convert to grayscale if needed
-  if (img.format != PIXELFORMAT_UNCOMPRESSED_GRAYSCALE) {
-    ImageFormat(&img, PIXELFORMAT_UNCOMPRESSED_GRAYSCALE);
+  if (img->width > 65536 || img->height > 65536) {
+    fprintf(stderr, "Error: Image too large for 16-bit points\n");
+    return NULL;
   }
 
-  int width = img.width;
-  int height = img.height;
-  unsigned char *pixels = (unsigned char *)img.data;
+  int width = img->width;
+  int height = img->height;
+  const unsigned char *pixels = img->data;
   size_t num_pixels = (size_t)width * height;
 
+  // Only dark pixels can hold points (white ones have a ~0 weight), so they
+  // bound what any request can get; a 320x320 glyph mask has ~15k of them.
+  size_t available = 0;
+  for (size_t i = 0; i < num_pixels; i++) {
+    available += pixels[i] < 255;
+  }
+  if (available == 0) {
+    fprintf(stderr, "Error: Image has no dark pixels\n");
+    return NULL;
+  }
+  int target = (size_t)num_points < available ? num_points : (int)available;
+
+  // Pixels are integral, so with min_distance <= 1 every dark pixel is a
+  // valid point; a saturating request gets all of them instead of spinning
+  // on rejections until it runs out of attempts.
+  if (min_distance <= 1.0f && target == (int)available) {
+    Point *points = (Point *)KD_MALLOC(ALLOC_SAMPLER, available * sizeof(Point));
+    if (!points) {
+      return NULL;
+    }
+    int n = 0;
+    for (size_t i = 0; i < num_pixels; i++) {
+      if (pixels[i] < 255) {
+        points[n].x = i % width;
+        points[n].y = i / width;
+        n++;
+      }
+    }
+    *out_num_points = n;
+    return points;
+  }
+
   // Calculate weights based on pixel darkness
-  double *weights = (double *)malloc(num_pixels * sizeof(double));
+  double *weights =
+      (double *)KD_MALLOC(ALLOC_SAMPLER, num_pixels * sizeof(double));
   double total_weight = 0.0;
   if (!weights) {
-    UnloadImage(img);
     return NULL;
   }
 
@@ -103,10 +69,10 @@ Point *distribute_points_on_image(Image *img_p, int num_points,
   }
 
   // Build cumulative distribution
-  double *cumulative = (double *)malloc(num_pixels * sizeof(double));
+  double *cumulative =
+      (double *)KD_MALLOC(ALLOC_SAMPLER, num_pixels * sizeof(double));
   if (!cumulative) {
-    free(weights);
-    UnloadImage(img);
+    KD_FREE(weights);
     return NULL;
   }
 
@@ -116,44 +82,81 @@ Point *distribute_points_on_image(Image *img_p, int num_points,
       cumulative[i] = cumulative[i - 1] + weights[i];
     }
   }
-  free(weights);
+  KD_FREE(weights);
 
   // Prepare points array
-  Point *points = (Point *)malloc(num_points * sizeof(Point));
+  Point *points =
+      (Point *)KD_MALLOC(ALLOC_SAMPLER, target * sizeof(Point));
   if (!points) {
-    free(cumulative);
-    UnloadImage(img);
+    KD_FREE(cumulative);
     return NULL;
   }
 
+  // Bucket accepted points into a grid of min_distance sized cells so the
+  // spacing check only looks at the 3x3 neighbourhood instead of every
+  // accepted point, which keeps large point counts tractable.
+  float cell_size = min_distance > 1.0f ? min_distance : 1.0f;
+  int grid_w = (int)(width / cell_size) + 1;
+  int grid_h = (int)(height / cell_size) + 1;
+  int *cell_head = (int *)KD_MALLOC(ALLOC_SAMPLER,
+                                    (size_t)grid_w * grid_h * sizeof(int));
+  int *cell_next =
+      (int *)KD_MALLOC(ALLOC_SAMPLER, target * sizeof(int));
+  if (!cell_head || !cell_next) {
+    KD_FREE(cell_head);
+    KD_FREE(cell_next);
+    KD_FREE(points);
+    KD_FREE(cumulative);
+    return NULL;
+  }
+  for (int i = 0; i < grid_w * grid_h; i++) {
+    cell_head[i] = -1;
+  }
+
   int accepted = 0;
-  int attempts = 0;
-  int max_attempts = num_points * 200;
+  long long attempts = 0;
+  long long max_attempts = (long long)target * 200;
   double min_dist_sq = min_distance * min_distance;
 
   // Generate points with rejection sampling
-  while (accepted < num_points && attempts < max_attempts) {
+  while (accepted < target && attempts < max_attempts) {
     attempts++;
 
-    // Random position weighted by darkness
+    // Random position weighted by darkness (binary search in the CDF)
     double r = ((double)rand() / RAND_MAX) * total_weight;
-    size_t index = 0;
-    while (index < num_pixels - 1 && cumulative[index] < r) {
-      index++;
+    size_t lo = 0;
+    size_t hi = num_pixels - 1;
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      if (cumulative[mid] < r)
+        lo = mid + 1;
+      else
+        hi = mid;
     }
+    size_t index = lo;
 
     int x = index % width;
     int y = index / width;
+    int cx = (int)(x / cell_size);
+    int cy = (int)(y / cell_size);
 
     // Check minimum distance
     int valid = 1;
-    for (int i = 0; i < accepted; i++) {
-      int dx = points[i].x - x;
-      int dy = points[i].y - y;
-      float dist_sq = dx * dx + dy * dy;
-      if (dist_sq < min_dist_sq) {
-        valid = 0;
-        break;
+    for (int gy = cy - 1; gy <= cy + 1 && valid; gy++) {
+      if (gy < 0 || gy >= grid_h)
+        continue;
+      for (int gx = cx - 1; gx <= cx + 1 && valid; gx++) {
+        if (gx < 0 || gx >= grid_w)
+          continue;
+        for (int i = cell_head[gy * grid_w + gx]; i != -1; i = cell_next[i]) {
+          int dx = points[i].x - x;
+          int dy = points[i].y - y;
+          float dist_sq = dx * dx + dy * dy;
+          if (dist_sq < min_dist_sq) {
+            valid = 0;
+            break;
+          }
+        }
       }
     }
 
@@ -161,21 +164,21 @@ Point *distribute_points_on_image(Image *img_p, int num_points,
     if (valid) {
       points[accepted].x = x;
       points[accepted].y = y;
+      cell_next[accepted] = cell_head[cy * grid_w + cx];
+      cell_head[cy * grid_w + cx] = accepted;
       accepted++;
     }
   }
 
   // Cleanup and return results
-  free(cumulative);
-  UnloadImage(img);
+  KD_FREE(cell_head);
+  KD_FREE(cell_next);
+  KD_FREE(cumulative);
 
   *out_num_points = accepted;
-  *out_width = width;
-  *out_height = height;
 
-  if (attempts >= max_attempts) {
-    fprintf(stderr, "Warning: Reached max attempts. Generated %d/%d points\n",
-            accepted, num_points);
+  if (accepted < num_points) {
+    fprintf(stderr, "Warning: Generated %d/%d points\n", accepted, num_points);
   }
 
   return points;
@@ -1,18 +1,14 @@
 #ifndef _SAMPLING
 #define _SAMPLING
-#include "raylib.h"
-Image *create_image(const char *text, const char *font_path, int width,
-                   int height);
-// Create image with a pre-loaded font (thread-safe, no texture loading)
-Image *create_image_with_font(const char *text, Font font, int font_size,
-                              int width, int height);
-typedef struct {
-  int x;
-  int y;
-} Point;
+#include "kd_types.h"
+#include "qpoints.h"
+// Pixel coordinates, 16-bit like every other quantized set
+typedef QPoint Point;
 
-Point *distribute_points_on_image(Image *img_p, int num_points,
-                                  float min_distance, int *out_num_points,
-                                  int *out_width, int *out_height);
+// Rejection-sample up to `num_points` points weighted by pixel darkness,
+// at least `min_distance` apart. The image is only read and may be at most
+// 65536 pixels on either side.
+Point *distribute_points_on_gray(const GrayImage *img, int num_points,
+                                 float min_distance, int *out_num_points);
 
 #endif
\ No newline at end of file
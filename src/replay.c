@@ -0,0 +1,139 @@
+#include "replay.h"
+#include "alloc_track.h"
+#include <stdint.h>
+#include <string.h>
+
+static const char replayMagic[4] = {'K', 'D', 'R', 'P'};
+
+bool OpenReplayWriter(ReplayFile *replay, const char *path, int pointCount) {
+  *replay = (ReplayFile){0};
+  if (pointCount <= 0)
+    return false;
+  replay->file = fopen(path, "wb");
+  if (replay->file == NULL)
+    return false;
+  replay->pointCount = pointCount;
+
+  uint32_t header[2] = {REPLAY_VERSION, (uint32_t)pointCount};
+  if (fwrite(replayMagic, sizeof(replayMagic), 1, replay->file) != 1 ||
+      fwrite(header, sizeof(header), 1, replay->file) != 1) {
+    CloseReplay(replay);
+    return false;
+  }
+  return true;
+}
+
+bool WriteReplayPointSet(ReplayFile *replay, const Vector2 *points) {
+  return fputc('P', replay->file) != EOF &&
+         fwrite(points, sizeof(Vector2), replay->pointCount, replay->file) ==
+             (size_t)replay->pointCount;
+}
+
+bool WriteReplayQPointSet(ReplayFile *replay, const QPointSet *set) {
+  if (set->count != replay->pointCount)
+    return false;
+  return fputc('Q', replay->file) != EOF &&
+         fwrite(&set->scale, sizeof(Vector2), 1, replay->file) == 1 &&
+         fwrite(&set->offset, sizeof(Vector2), 1, replay->file) == 1 &&
+         fwrite(set->points, sizeof(QPoint), set->count, replay->file) ==
+             (size_t)set->count;
+}
+
+bool WriteReplayFrame(ReplayFile *replay, float interpolation,
+                      int splitPolicy, float progress, float jitterTime) {
+  uint8_t policy = (uint8_t)splitPolicy;
+  return fputc('F', replay->file) != EOF &&
+         fwrite(&interpolation, sizeof(interpolation), 1, replay->file) == 1 &&
+         fwrite(&policy, sizeof(policy), 1, replay->file) == 1 &&
+         fwrite(&progress, sizeof(progress), 1, replay->file) == 1 &&
+         fwrite(&jitterTime, sizeof(jitterTime), 1, replay->file) == 1;
+}
+
+bool WriteReplayNoiseSeed(ReplayFile *replay, unsigned seed) {
+  uint32_t value = seed;
+  return fputc('N', replay->file) != EOF &&
+         fwrite(&value, sizeof(value), 1, replay->file) == 1;
+}
+
+bool OpenReplayReader(ReplayFile *replay, const char *path) {
+  *replay = (ReplayFile){0};
+  replay->file = fopen(path, "rb");
+  if (replay->file == NULL)
+    return false;
+
+  char magic[4];
+  uint32_t header[2];
+  if (fread(magic, sizeof(magic), 1, replay->file) != 1 ||
+      memcmp(magic, replayMagic, sizeof(magic)) != 0 ||
+      fread(header, sizeof(header), 1, replay->file) != 1 ||
+      header[0] < 1 || header[0] > REPLAY_VERSION || header[1] == 0 ||
+      header[1] > INT32_MAX) {
+    CloseReplay(replay);
+    return false;
+  }
+  replay->version = (int)header[0];
+  replay->pointCount = (int)header[1];
+  replay->points =
+      KD_MALLOC(ALLOC_PIPELINE, replay->pointCount * sizeof(Vector2));
+  replay->quantized =
+      KD_MALLOC(ALLOC_PIPELINE, replay->pointCount * sizeof(QPoint));
+  if (replay->points == NULL || replay->quantized == NULL) {
+    CloseReplay(replay);
+    return false;
+  }
+  return true;
+}
+
+ReplayEvent ReadReplayEvent(ReplayFile *replay) {
+  ReplayEvent event = {.type = REPLAY_ERROR};
+  int tag = fgetc(replay->file);
+  if (tag == EOF) {
+    event.type = feof(replay->file) ? REPLAY_END : REPLAY_ERROR;
+  } else if (tag == 'P') {
+    if (fread(replay->points, sizeof(Vector2), replay->pointCount,
+              replay->file) == (size_t)replay->pointCount) {
+      event.type = REPLAY_POINT_SET;
+      event.points = replay->points;
+    }
+  } else if (tag == 'Q') {
+    QPointSet set = {.points = replay->quantized,
+                     .count = replay->pointCount};
+    if (fread(&set.scale, sizeof(Vector2), 1, replay->file) == 1 &&
+        fread(&set.offset, sizeof(Vector2), 1, replay->file) == 1 &&
+        fread(set.points, sizeof(QPoint), set.count, replay->file) ==
+            (size_t)set.count) {
+      DecodeQPoints(&set, replay->points);
+      event.type = REPLAY_POINT_SET;
+      event.points = replay->points;
+    }
+  } else if (tag == 'F') {
+    uint8_t policy;
+    event.progress = -1.0f;
+    event.jitterTime = -1.0f;
+    if (fread(&event.interpolation, sizeof(float), 1, replay->file) == 1 &&
+        fread(&policy, sizeof(policy), 1, replay->file) == 1 &&
+        (replay->version < 3 ||
+         (fread(&event.progress, sizeof(float), 1, replay->file) == 1 &&
+          fread(&event.jitterTime, sizeof(float), 1, replay->file) == 1))) {
+      event.type = REPLAY_FRAME;
+      event.splitPolicy = policy;
+    }
+  } else if (tag == 'N' && replay->version >= 3) {
+    uint32_t seed;
+    if (fread(&seed, sizeof(seed), 1, replay->file) == 1) {
+      event.type = REPLAY_NOISE_SEED;
+      event.seed = seed;
+    }
+  }
+  return event;
+}
+
+bool CloseReplay(ReplayFile *replay) {
+  bool ok = true;
+  if (replay->file != NULL)
+    ok = fclose(replay->file) == 0;
+  KD_FREE(replay->points);
+  KD_FREE(replay->quantized);
+  *replay = (ReplayFile){0};
+  return ok;
+}
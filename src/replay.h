@@ -0,0 +1,70 @@
+#ifndef _REPLAY
+#define _REPLAY
+#include "kd_types.h"
+#include "qpoints.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+// Record of one run of the frame loop, so the same workload can be replayed
+// headless. Layout, native byte order:
+//
+//   header  "KDRP", uint32 version, uint32 pointCount
+//   'P'     pointCount Vector2        point set, in the order it arrived
+//   'Q'     Vector2 scale, Vector2    quantized point set (version 2),
+//           offset, pointCount QPoint decoded with DecodeQPoints
+//   'F'     float interpolation,      one frame; version 3 adds the
+//           uint8 split policy,       KDBatch progress and jitter time
+//           float progress,
+//           float jitter time
+//   'N'     uint32 seed               simplex1d_init_seed (version 3)
+//
+// The first two point sets are the initial origin and target. Every later
+// set becomes the new target and the previous target the new origin, the
+// same hand-over the game does when the producer delivers a set.
+#define REPLAY_VERSION 3
+
+typedef enum ReplayEventType {
+  REPLAY_END,
+  REPLAY_POINT_SET,
+  REPLAY_FRAME,
+  REPLAY_NOISE_SEED,
+  REPLAY_ERROR,
+} ReplayEventType;
+
+typedef struct ReplayEvent {
+  ReplayEventType type;
+  const Vector2 *points; // REPLAY_POINT_SET, valid until the next read
+  float interpolation;   // REPLAY_FRAME
+  int splitPolicy;       // REPLAY_FRAME, a KDSplitPolicy
+  float progress;        // REPLAY_FRAME, linear KDBatch progress, or -1 when
+                         // the frame was built with buildKDTreeEx (always
+                         // before version 3)
+  float jitterTime;      // REPLAY_FRAME, JitterKDBatchSplits time, or -1
+  unsigned seed;         // REPLAY_NOISE_SEED
+} ReplayEvent;
+
+typedef struct ReplayFile {
+  FILE *file;
+  int version;     // of the file being read
+  int pointCount;
+  Vector2 *points; // read buffer
+  QPoint *quantized;
+} ReplayFile;
+
+bool OpenReplayWriter(ReplayFile *replay, const char *path, int pointCount);
+bool WriteReplayPointSet(ReplayFile *replay, const Vector2 *points);
+// Half the size of a 'P' record; `set` must hold pointCount points
+bool WriteReplayQPointSet(ReplayFile *replay, const QPointSet *set);
+// `progress` is -1 for frames built with buildKDTreeEx, `jitterTime` -1
+// when the batch splits were not jittered
+bool WriteReplayFrame(ReplayFile *replay, float interpolation,
+                      int splitPolicy, float progress, float jitterTime);
+bool WriteReplayNoiseSeed(ReplayFile *replay, unsigned seed);
+
+// Reads version 1 to 3 files; 'Q' sets are decoded into Vector2s
+bool OpenReplayReader(ReplayFile *replay, const char *path);
+ReplayEvent ReadReplayEvent(ReplayFile *replay);
+
+// Closes either kind; returns false if buffered writes failed
+bool CloseReplay(ReplayFile *replay);
+#endif
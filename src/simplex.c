@@ -1,4 +1,5 @@
 #include "simplex.h"
+#include "cpu_features.h"
 #include <math.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -14,15 +15,21 @@ static const int8_t grad1[2] = {1, -1};
 // 排列表（512元素，重复一次用于快速索引）
 static uint8_t perm[PERM_SIZE * 2];
 
+// 批量接口用的32位排列表（向量gather只能按32位取数），以及预先取模12的版本
+static int32_t perm32[PERM_SIZE * 2];
+static int32_t perm12[PERM_SIZE * 2];
+
 // 初始化排列表（使用当前时间作为随机种子随机生成perm表）
-void simplex1d_init() {
+void simplex1d_init() { simplex1d_init_seed((unsigned int)time(NULL)); }
+
+// 用给定种子生成perm表，同一种子得到同一噪声（回放时复现）
+void simplex1d_init_seed(unsigned int seed) {
   // 初始化perm数组的前256个位置为0~255
   for (int i = 0; i < PERM_SIZE; i++) {
     perm[i] = (uint8_t)i;
   }
 
-  // 使用当前时间作为随机种子
-  srand((unsigned int)time(NULL));
+  srand(seed);
 
   // Fisher-Yates洗牌算法打乱perm数组
   for (int i = PERM_SIZE - 1; i > 0; i--) {
@@ -36,6 +43,12 @@ void simplex1d_init() {
   for (int i = 0; i < PERM_SIZE; i++) {
     perm[PERM_SIZE + i] = perm[i];
   }
+
+  // 同步生成批量接口的查找表
+  for (int i = 0; i < PERM_SIZE * 2; i++) {
+    perm32[i] = perm[i];
+    perm12[i] = perm[i] % 12;
+  }
 }
 
 // 光滑曲线函数（5次多项式）
@@ -188,4 +201,337 @@ float fractal_simplex2d(float x, float y, int octaves, float persistence) {
   }
 
   return total / max_value;
-}
\ No newline at end of file
+}
+
+// ---------------------------------------------------------------------------
+// 批量接口
+//
+// 与标量版本逐步对应：floor、查排列表、梯度贡献、衰减，倍频循环放在核函数
+// 内部，每个向量只加载/写回一次。不足一个向量宽度的尾部交给标量函数处理。
+// 核函数里刻意不用FMA，保持与标量版本相同的舍入顺序。
+
+// 2D梯度表拆成x/y两列32位整数，便于gather
+static const int32_t grad2x[12] = {1, -1, 1, -1, 1, -1, 1, -1, 0, 0, 0, 0};
+static const int32_t grad2y[12] = {1, 1, -1, -1, 0, 0, 0, 0, 1, -1, 1, -1};
+
+#if KD_HAVE_X86_SIMD
+// ---- SSE2：4路，无gather指令，用标量查表拼向量 ----
+
+static inline __m128 floor_sse(__m128 x) {
+  __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+  return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, x), _mm_set1_ps(1.0f)));
+}
+
+static inline __m128i gather_sse(const int32_t *table, __m128i index) {
+  int32_t idx[4];
+  _mm_storeu_si128((__m128i *)idx, index);
+  return _mm_setr_epi32(table[idx[0]], table[idx[1]], table[idx[2]],
+                        table[idx[3]]);
+}
+
+static inline __m128 simplex1d_sse(__m128 x) {
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128i mask = _mm_set1_epi32(PERM_MASK);
+  __m128 fl = floor_sse(x);
+  __m128i i0 = _mm_cvttps_epi32(fl);
+  __m128i i1 = _mm_add_epi32(i0, _mm_set1_epi32(1));
+  __m128 x0 = _mm_sub_ps(x, fl);
+  __m128 x1 = _mm_sub_ps(x0, one);
+
+  // 梯度方向 grad1[h & 1]：奇数时取负，直接翻转符号位
+  __m128i h0 = gather_sse(perm32, _mm_and_si128(i0, mask));
+  __m128i h1 = gather_sse(perm32, _mm_and_si128(i1, mask));
+  __m128 s0 = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(h0, _mm_set1_epi32(1)), 31));
+  __m128 s1 = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(h1, _mm_set1_epi32(1)), 31));
+  __m128 g0 = _mm_xor_ps(x0, s0);
+  __m128 g1 = _mm_xor_ps(x1, s1);
+
+  __m128 t0 = _mm_sub_ps(one, _mm_mul_ps(x0, x0));
+  __m128 t1 = _mm_sub_ps(one, _mm_mul_ps(x1, x1));
+  t0 = _mm_mul_ps(t0, t0);
+  t0 = _mm_mul_ps(t0, t0);
+  t1 = _mm_mul_ps(t1, t1);
+  t1 = _mm_mul_ps(t1, t1);
+
+  __m128 n = _mm_add_ps(_mm_mul_ps(g0, t0), _mm_mul_ps(g1, t1));
+  return _mm_mul_ps(_mm_set1_ps(3.5f), n);
+}
+
+static inline __m128 corner2d_sse(__m128 x, __m128 y, __m128i gi) {
+  __m128 t = _mm_sub_ps(_mm_sub_ps(_mm_set1_ps(0.5f), _mm_mul_ps(x, x)),
+                        _mm_mul_ps(y, y));
+  __m128 gx = _mm_cvtepi32_ps(gather_sse(grad2x, gi));
+  __m128 gy = _mm_cvtepi32_ps(gather_sse(grad2y, gi));
+  __m128 dot = _mm_add_ps(_mm_mul_ps(gx, x), _mm_mul_ps(gy, y));
+  // t < 0 的角没有贡献（要在取平方前判断）
+  __m128 negative = _mm_cmplt_ps(t, _mm_setzero_ps());
+  t = _mm_mul_ps(t, t);
+  __m128 n = _mm_mul_ps(_mm_mul_ps(t, t), dot);
+  return _mm_andnot_ps(negative, n);
+}
+
+static inline __m128 simplex2d_sse(__m128 x, __m128 y) {
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 g2 = _mm_set1_ps(G2);
+  const __m128i mask = _mm_set1_epi32(PERM_MASK);
+  const __m128i ione = _mm_set1_epi32(1);
+
+  __m128 s = _mm_mul_ps(_mm_add_ps(x, y), _mm_set1_ps(F2));
+  __m128 fi = floor_sse(_mm_add_ps(x, s));
+  __m128 fj = floor_sse(_mm_add_ps(y, s));
+  __m128 t = _mm_mul_ps(_mm_add_ps(fi, fj), g2);
+  __m128 x0 = _mm_sub_ps(x, _mm_sub_ps(fi, t));
+  __m128 y0 = _mm_sub_ps(y, _mm_sub_ps(fj, t));
+
+  // x0 > y0 时第二个角取 (1,0)，否则 (0,1)
+  __m128 upper = _mm_cmpgt_ps(x0, y0);
+  __m128 i1 = _mm_and_ps(upper, one);
+  __m128 j1 = _mm_andnot_ps(upper, one);
+  __m128 x1 = _mm_add_ps(_mm_sub_ps(x0, i1), g2);
+  __m128 y1 = _mm_add_ps(_mm_sub_ps(y0, j1), g2);
+  __m128 x2 = _mm_add_ps(_mm_sub_ps(x0, one), _mm_set1_ps(2.0f * G2));
+  __m128 y2 = _mm_add_ps(_mm_sub_ps(y0, one), _mm_set1_ps(2.0f * G2));
+
+  __m128i ii = _mm_and_si128(_mm_cvttps_epi32(fi), mask);
+  __m128i jj = _mm_and_si128(_mm_cvttps_epi32(fj), mask);
+  __m128i ii1 = _mm_cvttps_epi32(i1);
+  __m128i jj1 = _mm_cvttps_epi32(j1);
+  __m128i gi0 = gather_sse(perm12, _mm_add_epi32(ii, gather_sse(perm32, jj)));
+  __m128i gi1 = gather_sse(
+      perm12, _mm_add_epi32(_mm_add_epi32(ii, ii1),
+                            gather_sse(perm32, _mm_add_epi32(jj, jj1))));
+  __m128i gi2 = gather_sse(
+      perm12, _mm_add_epi32(_mm_add_epi32(ii, ione),
+                            gather_sse(perm32, _mm_add_epi32(jj, ione))));
+
+  __m128 n = _mm_add_ps(_mm_add_ps(corner2d_sse(x0, y0, gi0),
+                                   corner2d_sse(x1, y1, gi1)),
+                        corner2d_sse(x2, y2, gi2));
+  return _mm_mul_ps(_mm_set1_ps(70.0f), n);
+}
+
+static int fractal1d_sse(const float *x, float *out, int count, int octaves,
+                         float persistence) {
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128 xv = _mm_loadu_ps(x + i);
+    __m128 total = _mm_setzero_ps();
+    float frequency = 1.0f;
+    float amplitude = 1.0f;
+    float max_value = 0.0f;
+    for (int o = 0; o < octaves; o++) {
+      __m128 n = simplex1d_sse(_mm_mul_ps(xv, _mm_set1_ps(frequency)));
+      total = _mm_add_ps(total, _mm_mul_ps(n, _mm_set1_ps(amplitude)));
+      max_value += amplitude;
+      amplitude *= persistence;
+      frequency *= 2.0f;
+    }
+    _mm_storeu_ps(out + i, _mm_div_ps(total, _mm_set1_ps(max_value)));
+  }
+  return i;
+}
+
+static int fractal2d_sse(const float *x, const float *y, float *out,
+                         int count, int octaves, float persistence) {
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128 xv = _mm_loadu_ps(x + i);
+    __m128 yv = _mm_loadu_ps(y + i);
+    __m128 total = _mm_setzero_ps();
+    float frequency = 1.0f;
+    float amplitude = 1.0f;
+    float max_value = 0.0f;
+    for (int o = 0; o < octaves; o++) {
+      __m128 f = _mm_set1_ps(frequency);
+      __m128 n = simplex2d_sse(_mm_mul_ps(xv, f), _mm_mul_ps(yv, f));
+      total = _mm_add_ps(total, _mm_mul_ps(n, _mm_set1_ps(amplitude)));
+      max_value += amplitude;
+      amplitude *= persistence;
+      frequency *= 2.0f;
+    }
+    _mm_storeu_ps(out + i, _mm_div_ps(total, _mm_set1_ps(max_value)));
+  }
+  return i;
+}
+
+// ---- AVX2：8路，排列表和梯度表用硬件gather ----
+
+// 只开avx2不开fma，编译器就不会把乘加合并成FMA，舍入与标量版本一致
+#define SIMPLEX_TARGET_AVX2 __attribute__((target("avx2")))
+
+SIMPLEX_TARGET_AVX2 static inline __m256 simplex1d_avx2(__m256 x) {
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256i mask = _mm256_set1_epi32(PERM_MASK);
+  __m256 fl = _mm256_floor_ps(x);
+  __m256i i0 = _mm256_cvttps_epi32(fl);
+  __m256i i1 = _mm256_add_epi32(i0, _mm256_set1_epi32(1));
+  __m256 x0 = _mm256_sub_ps(x, fl);
+  __m256 x1 = _mm256_sub_ps(x0, one);
+
+  __m256i h0 = _mm256_i32gather_epi32(perm32, _mm256_and_si256(i0, mask), 4);
+  __m256i h1 = _mm256_i32gather_epi32(perm32, _mm256_and_si256(i1, mask), 4);
+  __m256 s0 = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(h0, _mm256_set1_epi32(1)), 31));
+  __m256 s1 = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(h1, _mm256_set1_epi32(1)), 31));
+  __m256 g0 = _mm256_xor_ps(x0, s0);
+  __m256 g1 = _mm256_xor_ps(x1, s1);
+
+  __m256 t0 = _mm256_sub_ps(one, _mm256_mul_ps(x0, x0));
+  __m256 t1 = _mm256_sub_ps(one, _mm256_mul_ps(x1, x1));
+  t0 = _mm256_mul_ps(t0, t0);
+  t0 = _mm256_mul_ps(t0, t0);
+  t1 = _mm256_mul_ps(t1, t1);
+  t1 = _mm256_mul_ps(t1, t1);
+
+  __m256 n = _mm256_add_ps(_mm256_mul_ps(g0, t0), _mm256_mul_ps(g1, t1));
+  return _mm256_mul_ps(_mm256_set1_ps(3.5f), n);
+}
+
+SIMPLEX_TARGET_AVX2 static inline __m256 corner2d_avx2(__m256 x, __m256 y,
+                                                  __m256i gi) {
+  __m256 t = _mm256_sub_ps(
+      _mm256_sub_ps(_mm256_set1_ps(0.5f), _mm256_mul_ps(x, x)),
+      _mm256_mul_ps(y, y));
+  __m256 gx = _mm256_cvtepi32_ps(_mm256_i32gather_epi32(grad2x, gi, 4));
+  __m256 gy = _mm256_cvtepi32_ps(_mm256_i32gather_epi32(grad2y, gi, 4));
+  __m256 dot = _mm256_add_ps(_mm256_mul_ps(gx, x), _mm256_mul_ps(gy, y));
+  __m256 negative = _mm256_cmp_ps(t, _mm256_setzero_ps(), _CMP_LT_OQ);
+  t = _mm256_mul_ps(t, t);
+  __m256 n = _mm256_mul_ps(_mm256_mul_ps(t, t), dot);
+  return _mm256_andnot_ps(negative, n);
+}
+
+SIMPLEX_TARGET_AVX2 static inline __m256 simplex2d_avx2(__m256 x, __m256 y) {
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 g2 = _mm256_set1_ps(G2);
+  const __m256i mask = _mm256_set1_epi32(PERM_MASK);
+  const __m256i ione = _mm256_set1_epi32(1);
+
+  __m256 s = _mm256_mul_ps(_mm256_add_ps(x, y), _mm256_set1_ps(F2));
+  __m256 fi = _mm256_floor_ps(_mm256_add_ps(x, s));
+  __m256 fj = _mm256_floor_ps(_mm256_add_ps(y, s));
+  __m256 t = _mm256_mul_ps(_mm256_add_ps(fi, fj), g2);
+  __m256 x0 = _mm256_sub_ps(x, _mm256_sub_ps(fi, t));
+  __m256 y0 = _mm256_sub_ps(y, _mm256_sub_ps(fj, t));
+
+  __m256 upper = _mm256_cmp_ps(x0, y0, _CMP_GT_OQ);
+  __m256 i1 = _mm256_and_ps(upper, one);
+  __m256 j1 = _mm256_andnot_ps(upper, one);
+  __m256 x1 = _mm256_add_ps(_mm256_sub_ps(x0, i1), g2);
+  __m256 y1 = _mm256_add_ps(_mm256_sub_ps(y0, j1), g2);
+  __m256 x2 = _mm256_add_ps(_mm256_sub_ps(x0, one), _mm256_set1_ps(2.0f * G2));
+  __m256 y2 = _mm256_add_ps(_mm256_sub_ps(y0, one), _mm256_set1_ps(2.0f * G2));
+
+  __m256i ii = _mm256_and_si256(_mm256_cvttps_epi32(fi), mask);
+  __m256i jj = _mm256_and_si256(_mm256_cvttps_epi32(fj), mask);
+  __m256i ii1 = _mm256_cvttps_epi32(i1);
+  __m256i jj1 = _mm256_cvttps_epi32(j1);
+  __m256i p0 = _mm256_i32gather_epi32(perm32, jj, 4);
+  __m256i p1 = _mm256_i32gather_epi32(perm32, _mm256_add_epi32(jj, jj1), 4);
+  __m256i p2 = _mm256_i32gather_epi32(perm32, _mm256_add_epi32(jj, ione), 4);
+  __m256i gi0 = _mm256_i32gather_epi32(perm12, _mm256_add_epi32(ii, p0), 4);
+  __m256i gi1 = _mm256_i32gather_epi32(
+      perm12, _mm256_add_epi32(_mm256_add_epi32(ii, ii1), p1), 4);
+  __m256i gi2 = _mm256_i32gather_epi32(
+      perm12, _mm256_add_epi32(_mm256_add_epi32(ii, ione), p2), 4);
+
+  __m256 n = _mm256_add_ps(_mm256_add_ps(corner2d_avx2(x0, y0, gi0),
+                                         corner2d_avx2(x1, y1, gi1)),
+                           corner2d_avx2(x2, y2, gi2));
+  return _mm256_mul_ps(_mm256_set1_ps(70.0f), n);
+}
+
+SIMPLEX_TARGET_AVX2 static int fractal1d_avx2(const float *x, float *out,
+                                         int count, int octaves,
+                                         float persistence) {
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256 xv = _mm256_loadu_ps(x + i);
+    __m256 total = _mm256_setzero_ps();
+    float frequency = 1.0f;
+    float amplitude = 1.0f;
+    float max_value = 0.0f;
+    for (int o = 0; o < octaves; o++) {
+      __m256 n = simplex1d_avx2(_mm256_mul_ps(xv, _mm256_set1_ps(frequency)));
+      total = _mm256_add_ps(total, _mm256_mul_ps(n, _mm256_set1_ps(amplitude)));
+      max_value += amplitude;
+      amplitude *= persistence;
+      frequency *= 2.0f;
+    }
+    _mm256_storeu_ps(out + i, _mm256_div_ps(total, _mm256_set1_ps(max_value)));
+  }
+  return i;
+}
+
+SIMPLEX_TARGET_AVX2 static int fractal2d_avx2(const float *x, const float *y,
+                                         float *out, int count, int octaves,
+                                         float persistence) {
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256 xv = _mm256_loadu_ps(x + i);
+    __m256 yv = _mm256_loadu_ps(y + i);
+    __m256 total = _mm256_setzero_ps();
+    float frequency = 1.0f;
+    float amplitude = 1.0f;
+    float max_value = 0.0f;
+    for (int o = 0; o < octaves; o++) {
+      __m256 f = _mm256_set1_ps(frequency);
+      __m256 n = simplex2d_avx2(_mm256_mul_ps(xv, f), _mm256_mul_ps(yv, f));
+      total = _mm256_add_ps(total, _mm256_mul_ps(n, _mm256_set1_ps(amplitude)));
+      max_value += amplitude;
+      amplitude *= persistence;
+      frequency *= 2.0f;
+    }
+    _mm256_storeu_ps(out + i, _mm256_div_ps(total, _mm256_set1_ps(max_value)));
+  }
+  return i;
+}
+#endif
+
+void fractal_simplex1d_batch(const float *x, float *out, int count,
+                             int octaves, float persistence) {
+  int done = 0;
+  switch (GetKDSimdLevel()) {
+#if KD_HAVE_X86_SIMD
+  case KD_SIMD_AVX2:
+    done = fractal1d_avx2(x, out, count, octaves, persistence);
+    break;
+  case KD_SIMD_SSE2:
+    done = fractal1d_sse(x, out, count, octaves, persistence);
+    break;
+#endif
+  default:
+    break;
+  }
+  for (int i = done; i < count; i++) {
+    out[i] = fractal_simplex1d(x[i], octaves, persistence);
+  }
+}
+
+void fractal_simplex2d_batch(const float *x, const float *y, float *out,
+                             int count, int octaves, float persistence) {
+  int done = 0;
+  switch (GetKDSimdLevel()) {
+#if KD_HAVE_X86_SIMD
+  case KD_SIMD_AVX2:
+    done = fractal2d_avx2(x, y, out, count, octaves, persistence);
+    break;
+  case KD_SIMD_SSE2:
+    done = fractal2d_sse(x, y, out, count, octaves, persistence);
+    break;
+#endif
+  default:
+    break;
+  }
+  for (int i = done; i < count; i++) {
+    out[i] = fractal_simplex2d(x[i], y[i], octaves, persistence);
+  }
+}
+
+// 单倍频即为原始噪声（total / max_value = n / 1）
+void simplex1d_batch(const float *x, float *out, int count) {
+  fractal_simplex1d_batch(x, out, count, 1, 1.0f);
+}
+
+void simplex2d_batch(const float *x, const float *y, float *out, int count) {
+  fractal_simplex2d_batch(x, y, out, count, 1, 1.0f);
+}
@@ -5,8 +5,10 @@
 extern "C" {
 #endif
 
-// 初始化噪声系统
+// 初始化噪声系统（以当前时间为种子）
 void simplex1d_init();
+// 以固定种子初始化，噪声可复现
+void simplex1d_init_seed(unsigned int seed);
 
 // 生成一维Simplex噪声
 float simplex1d(float x);
@@ -16,6 +18,15 @@ float fractal_simplex1d(float x, int octaves, float persistence);
 
 float simplex2d(float x, float y);
 float fractal_simplex2d(float x, float y, int octaves, float persistence);
+
+// 批量接口：一次对 count 个坐标求值（按 GetKDSimdLevel() 选 AVX2 8路 /
+// SSE2 4路 / 标量），结果与对应的标量函数在浮点误差范围内一致
+void simplex1d_batch(const float *x, float *out, int count);
+void simplex2d_batch(const float *x, const float *y, float *out, int count);
+void fractal_simplex1d_batch(const float *x, float *out, int count,
+                             int octaves, float persistence);
+void fractal_simplex2d_batch(const float *x, const float *y, float *out,
+                             int count, int octaves, float persistence);
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,18 @@
+#ifndef _KD_TEST
+#define _KD_TEST
+#include <stdio.h>
+
+// Minimal checks for the CTest executables: a failed CHECK is reported with
+// its location and the run keeps going; main returns KD_TEST_RESULT().
+static int kdTestFailures = 0;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+      kdTestFailures++;                                                        \
+    }                                                                          \
+  } while (0)
+
+#define KD_TEST_RESULT() (kdTestFailures == 0 ? 0 : 1)
+#endif
@@ -0,0 +1,55 @@
+#include "alloc_track.h"
+#include "kd_test.h"
+#include <stdint.h>
+#include <string.h>
+
+// Built twice: against kdtree_core as configured, and as test_alloc_tracked
+// with alloc_track.c compiled in with KDTREE_TRACK_ALLOC
+int main(void) {
+  // count * size overflowing size_t must fail instead of wrapping around
+  CHECK(KD_CALLOC(ALLOC_PIPELINE, SIZE_MAX / 2 + 1, 2) == NULL);
+  CHECK(KD_CALLOC(ALLOC_PIPELINE, 2, SIZE_MAX / 2 + 1) == NULL);
+  CHECK(KD_MALLOC(ALLOC_PIPELINE, SIZE_MAX) == NULL);
+
+  unsigned char *zeroed = KD_CALLOC(ALLOC_PIPELINE, 100, 3);
+  CHECK(zeroed != NULL);
+  bool allZero = true;
+  for (int i = 0; zeroed && i < 300; i++) {
+    allZero = allZero && zeroed[i] == 0;
+  }
+  CHECK(allZero);
+
+  char *text = KD_MALLOC(ALLOC_SAMPLER, 6);
+  memcpy(text, "hello", 6);
+  text = KD_REALLOC(ALLOC_SAMPLER, text, 4096);
+  CHECK(text != NULL && strcmp(text, "hello") == 0);
+
+  FILE *report = tmpfile();
+  CHECK(report != NULL);
+  if (AllocTrackingEnabled()) {
+    AllocStats pipeline = GetAllocStats(ALLOC_PIPELINE);
+    AllocStats sampler = GetAllocStats(ALLOC_SAMPLER);
+    CHECK(pipeline.liveBytes == 300 && pipeline.liveBlocks == 1);
+    CHECK(sampler.liveBytes == 4096 && sampler.liveBlocks == 1);
+    CHECK(sampler.peakBytes == 4096 && sampler.totalAllocs == 2);
+    CHECK(ReportOutstandingAllocs(report) == 2);
+    CHECK(ftell(report) > 0);
+  }
+
+  KD_FREE(zeroed);
+  KD_FREE(text);
+  KD_FREE(NULL);
+  rewind(report);
+  CHECK(ReportOutstandingAllocs(report) == 0);
+  for (int i = 0; i < ALLOC_SUBSYSTEM_COUNT; i++) {
+    AllocStats s = GetAllocStats((AllocSubsystem)i);
+    CHECK(s.liveBytes == 0 && s.liveBlocks == 0);
+  }
+  if (!AllocTrackingEnabled()) {
+    // Untracked builds report nothing at all
+    CHECK(ftell(report) == 0);
+    CHECK(GetAllocStats(ALLOC_SAMPLER).totalAllocs == 0);
+  }
+  fclose(report);
+  return KD_TEST_RESULT();
+}
@@ -0,0 +1,88 @@
+#include "alloc_track.h"
+#include "kd_test.h"
+#include "kdtree.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Linked against kdtree.c alone with this allocator instead of
+// alloc_track.c, so the kd-tree builders can be made to run out of memory
+// at every allocation in turn
+static int allocsLeft = -1; // -1 never fails
+static int liveBlocks = 0;
+
+void *TrackedMalloc(AllocSubsystem subsystem, size_t size, const char *file,
+                    int line) {
+  (void)subsystem, (void)file, (void)line;
+  if (allocsLeft == 0)
+    return NULL;
+  if (allocsLeft > 0)
+    allocsLeft--;
+  void *ptr = malloc(size);
+  liveBlocks += ptr != NULL;
+  return ptr;
+}
+
+void *TrackedCalloc(AllocSubsystem subsystem, size_t count, size_t size,
+                    const char *file, int line) {
+  void *ptr = TrackedMalloc(subsystem, count * size, file, line);
+  return ptr ? memset(ptr, 0, count * size) : NULL;
+}
+
+void *TrackedRealloc(AllocSubsystem subsystem, void *ptr, size_t size,
+                     const char *file, int line) {
+  (void)subsystem, (void)file, (void)line;
+  return realloc(ptr, size);
+}
+
+void TrackedFree(void *ptr) {
+  liveBlocks -= ptr != NULL;
+  free(ptr);
+}
+
+#define COUNT 200
+
+int main(void) {
+  srand(31);
+  static Vector2 origin[COUNT], target[COUNT];
+  for (int i = 0; i < COUNT; i++) {
+    origin[i] = (Vector2){(float)(rand() % 800), (float)(rand() % 800)};
+    target[i] = (Vector2){(float)(rand() % 800), (float)(rand() % 800)};
+  }
+
+  // Failing the n-th allocation of any policy's build returns NULL and
+  // frees everything built so far
+  for (int policy = 0; policy < KD_SPLIT_POLICY_COUNT; policy++) {
+    KDBuildOptions options = {.policy = (KDSplitPolicy)policy,
+                              .bounds = {0, 0, 800, 800}};
+    bool clean = true;
+    for (int n = 0; n < COUNT + 1; n += 7) {
+      allocsLeft = n;
+      TreeNode *tree =
+          buildKDTreeEx(origin, target, COUNT, 0, NULL, 0.5, &options);
+      clean = clean && tree == NULL && liveBlocks == 0;
+      freeTree(tree);
+    }
+    if (!clean) {
+      fprintf(stderr, "%s build leaks or succeeds without memory\n",
+              KDSplitPolicyName((KDSplitPolicy)policy));
+      kdTestFailures++;
+    }
+  }
+  allocsLeft = COUNT - 1;
+  CHECK(buildKDTree(origin, target, COUNT, 0, NULL, 0.0) == NULL);
+  CHECK(liveBlocks == 0);
+
+  // Insert without memory leaves the tree as it was
+  allocsLeft = -1;
+  TreeNode *tree = buildKDTree(origin, origin, COUNT, 0, NULL, 1.0);
+  CHECK(tree != NULL && tree->count == COUNT);
+  allocsLeft = 0;
+  CHECK(InsertKDTree(tree, (Vector2){5, 5}) == tree);
+  CHECK(tree->count == COUNT && tree->size == COUNT);
+  CHECK(CountKDTreeRange(tree, (Rectangle){0, 0, 800, 800}) == COUNT);
+  CHECK(InsertKDTree(NULL, (Vector2){5, 5}) == NULL);
+  allocsLeft = -1;
+  freeTree(tree);
+  CHECK(liveBlocks == 0);
+  return KD_TEST_RESULT();
+}
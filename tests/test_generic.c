@@ -0,0 +1,107 @@
+#include "alloc_track.h"
+#include "kd_test.h"
+#include "kdtree_instances.h"
+#include <stdlib.h>
+
+#define COUNT 2000
+#define QUERIES 500
+
+static float RandomCoord(void) {
+  // Coarse grid so distance ties and equal split coordinates show up
+  return (float)(rand() % 200) * 0.5f;
+}
+
+// Nearest neighbour of every query must have the brute-force distance; the
+// index may differ between equally distant points
+#define CHECK_NEAREST(Name, points, query)                                     \
+  do {                                                                         \
+    float best = -1.0f;                                                        \
+    for (int i = 0; i < COUNT; i++) {                                          \
+      float d2 = (float)KDDistance2(points[i], query);                         \
+      if (best < 0 || d2 < best)                                               \
+        best = d2;                                                             \
+    }                                                                          \
+    float found2 = 0;                                                          \
+    int found = Name##Nearest(&tree, query, &found2);                          \
+    CHECK(found >= 0 && found < tree.count);                                   \
+    CHECK(found2 == best);                                                     \
+    CHECK((float)KDDistance2(tree.nodes[found].point, query) == best);         \
+  } while (0)
+
+static void Test2f(void) {
+  static KDTree2fPoint points[COUNT], origin[COUNT], target[COUNT];
+  for (int i = 0; i < COUNT; i++) {
+    points[i] = (KDTree2fPoint){{RandomCoord(), RandomCoord()}};
+    origin[i] = target[i] = points[i];
+  }
+  KDTree2f tree = {0};
+  CHECK(KDBuild(&tree, origin, target, COUNT, 0, 0.5f));
+  CHECK(tree.count == COUNT);
+  for (int q = 0; q < QUERIES; q++) {
+    KDTree2fPoint query = {{RandomCoord() * 1.2f - 10, RandomCoord() * 1.2f - 10}};
+    CHECK_NEAREST(KDTree2f, points, query);
+  }
+
+  // Rebuilding frees the previous nodes instead of leaking them
+  AllocStats before = GetAllocStats(ALLOC_KDTREE);
+  CHECK(KDBuild(&tree, origin, target, COUNT / 2, 1, 0.0f));
+  CHECK(tree.count == COUNT / 2);
+  CHECK(GetAllocStats(ALLOC_KDTREE).liveBlocks == before.liveBlocks);
+  KDFree(&tree);
+  CHECK(tree.nodes == NULL && tree.count == 0);
+
+  KDTree2fPoint query = {{1, 1}};
+  CHECK(KDNearest(&tree, query, NULL) == -1);
+}
+
+static void Test3f(void) {
+  static KDTree3fPoint points[COUNT], origin[COUNT], target[COUNT];
+  for (int i = 0; i < COUNT; i++) {
+    points[i] = (KDTree3fPoint){{RandomCoord(), RandomCoord(), RandomCoord()}};
+    origin[i] = target[i] = points[i];
+  }
+  KDTree3f tree = {0};
+  // Every root axis, so each level's axis cycles through x, y and z
+  for (int depth = 0; depth < 3; depth++) {
+    CHECK(KDBuild(&tree, origin, target, COUNT, depth, 1.0f));
+    CHECK(tree.nodes[0].axis == depth);
+    for (int q = 0; q < QUERIES / 3; q++) {
+      KDTree3fPoint query = {{RandomCoord(), RandomCoord(), RandomCoord()}};
+      CHECK_NEAREST(KDTree3f, points, query);
+    }
+  }
+  KDFree(&tree);
+}
+
+// Origin and target pair by rank, so at interpolation 0 and 1 the tree holds
+// exactly one of the two sets
+static void TestInterpolationEnds(void) {
+  static KDTree2dPoint origin[COUNT], target[COUNT];
+  double originSum = 0, targetSum = 0;
+  for (int i = 0; i < COUNT; i++) {
+    origin[i] = (KDTree2dPoint){{RandomCoord(), RandomCoord()}};
+    target[i] = (KDTree2dPoint){{RandomCoord() + 500, RandomCoord()}};
+    originSum += origin[i].v[0] + origin[i].v[1];
+    targetSum += target[i].v[0] + target[i].v[1];
+  }
+  KDTree2d tree = {0};
+  double sums[2];
+  for (int end = 0; end < 2; end++) {
+    CHECK(KDBuild(&tree, origin, target, COUNT, 0, (double)end));
+    sums[end] = 0;
+    for (int i = 0; i < tree.count; i++) {
+      sums[end] += tree.nodes[i].point.v[0] + tree.nodes[i].point.v[1];
+    }
+  }
+  CHECK(sums[0] == originSum);
+  CHECK(sums[1] == targetSum);
+  KDFree(&tree);
+}
+
+int main(void) {
+  srand(9);
+  Test2f();
+  Test3f();
+  TestInterpolationEnds();
+  return KD_TEST_RESULT();
+}
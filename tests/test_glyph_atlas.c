@@ -0,0 +1,44 @@
+#include "glyph_atlas.h"
+#include "kd_test.h"
+#include <string.h>
+
+int main(void) {
+  // Two 3x2 glyphs: '1' is solid ink, '0' is half coverage
+  unsigned char coverage[2 * 6] = {255, 255, 255, 128, 128, 128,
+                                   255, 255, 255, 128, 128, 128};
+  GlyphAtlas atlas = {.coverage = coverage,
+                      .atlasWidth = 6,
+                      .atlasHeight = 2,
+                      .glyphCount = 2,
+                      .spacing = 1,
+                      .chars = "10",
+                      .glyphX = {0, 3},
+                      .glyphWidth = {3, 3}};
+
+  unsigned char pixels[10 * 4];
+  GrayImage image = {pixels, 10, 4};
+
+  // "10" is 6 px wide without spacing, so it starts at x = 2; row 1 is the
+  // glyph top on a 4 px tall image
+  RasterizeGlyphText(&atlas, "10", &image);
+  CHECK(pixels[0] == 255 && pixels[1 * 10 + 1] == 255);
+  CHECK(pixels[1 * 10 + 2] == 0 && pixels[2 * 10 + 4] == 0);
+  CHECK(pixels[1 * 10 + 5] == 255); // the spacing column
+  CHECK(pixels[1 * 10 + 6] == 127 && pixels[2 * 10 + 8] == 127);
+  CHECK(pixels[1 * 10 + 9] == 255);
+  CHECK(pixels[3 * 10 + 4] == 255);
+
+  // Characters missing from the atlas are skipped, the target is cleared
+  unsigned char before[sizeof(pixels)];
+  memset(before, 255, sizeof(before));
+  RasterizeGlyphText(&atlas, "x", &image);
+  CHECK(memcmp(pixels, before, sizeof(pixels)) == 0);
+
+  // Text wider than the target is clipped, not written out of bounds
+  unsigned char small[2 * 2 + 1];
+  small[4] = 42;
+  GrayImage tiny = {small, 2, 2};
+  RasterizeGlyphText(&atlas, "1010", &tiny);
+  CHECK(small[4] == 42);
+  return KD_TEST_RESULT();
+}
@@ -0,0 +1,123 @@
+#include "cpu_features.h"
+#include "kd_batch.h"
+#include "kd_test.h"
+#include "kdtree.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Tree sizes around the 4 and 8 lane widths, plus a few larger trees; more
+// than 8 trees so the eased progress also has a vector body and a tail
+static const int kTreeSizes[] = {1, 2, 3, 4, 5, 7, 8, 9, 13, 100, 1000};
+#define TREE_COUNT (int)(sizeof(kTreeSizes) / sizeof(kTreeSizes[0]))
+#define MAX_POINTS 1000
+
+static const Rectangle kBounds = {0, 0, 800, 800};
+
+static void RandomPoints(Vector2 *points, int count) {
+  for (int i = 0; i < count; i++) {
+    points[i] = (Vector2){(float)(rand() % 8000) * 0.1f,
+                          (float)(rand() % 8000) * 0.1f};
+  }
+}
+
+static bool SegmentsClose(const Vector2 *a, const Vector2 *b, int count,
+                          float tolerance) {
+  for (int i = 0; i < 2 * count; i++) {
+    if (fabsf(a[i].x - b[i].x) > tolerance ||
+        fabsf(a[i].y - b[i].y) > tolerance)
+      return false;
+  }
+  return true;
+}
+
+int main(void) {
+  srand(5);
+  static Vector2 origin[TREE_COUNT][MAX_POINTS];
+  static Vector2 target[TREE_COUNT][MAX_POINTS];
+  KDBatch batch;
+  InitKDBatch(&batch);
+  int segmentTotal = 0;
+  for (int t = 0; t < TREE_COUNT; t++) {
+    RandomPoints(origin[t], kTreeSizes[t]);
+    RandomPoints(target[t], kTreeSizes[t]);
+    CHECK(AddKDBatchTree(&batch, origin[t], target[t], kTreeSizes[t], 1,
+                         kBounds) == t);
+    // Both ends of the easing curve, its midpoint and values in between
+    float progress = t == 0 ? 0.0f : (t == 1 ? 1.0f : (t == 2 ? 0.5f : 0.09f * t));
+    SetKDBatchTreeProgress(&batch, t, progress);
+    segmentTotal += kTreeSizes[t];
+  }
+  CHECK(GetKDBatchSegmentCount(&batch) == segmentTotal);
+
+  Vector2 *reference = malloc(2 * segmentTotal * sizeof(Vector2));
+  Vector2 *segments = malloc(2 * segmentTotal * sizeof(Vector2));
+  float eased[TREE_COUNT];
+  KDSimdLevel best = GetKDSimdLevel();
+  CHECK(SetKDSimdLevel(KD_SIMD_SCALAR) == KD_SIMD_SCALAR);
+  UpdateKDBatch(&batch);
+  memcpy(eased, batch.eased, sizeof(eased));
+  CHECK(EmitKDBatchSegments(&batch, 0.0f, reference, segmentTotal) == segmentTotal);
+  CHECK(eased[0] == 0.0f && eased[1] == 1.0f && eased[2] == 0.5f);
+
+  // Every kernel the CPU can run matches the scalar one; FMA may round the
+  // last bit differently
+  for (int level = KD_SIMD_SCALAR; level <= best; level++) {
+    CHECK(SetKDSimdLevel((KDSimdLevel)level) == (KDSimdLevel)level);
+    memset(batch.split, 0, batch.slotCount * sizeof(float));
+    UpdateKDBatch(&batch);
+    for (int t = 0; t < TREE_COUNT; t++) {
+      CHECK(fabsf(batch.eased[t] - eased[t]) <= 1e-6f);
+    }
+    CHECK(EmitKDBatchSegments(&batch, 0.0f, segments, segmentTotal) == segmentTotal);
+    if (!SegmentsClose(segments, reference, segmentTotal, 1e-3f)) {
+      fprintf(stderr, "%s kernel differs from scalar\n",
+              KDSimdLevelName((KDSimdLevel)level));
+      kdTestFailures++;
+    }
+  }
+  // Levels above what the CPU supports are clamped
+  CHECK(SetKDSimdLevel(KD_SIMD_AVX2) == best);
+  CHECK(GetKDSimdLevel() == best);
+
+  // And the batch draws the same lines as building each tree at the eased
+  // interpolation (the flattening reordered both sets, which keeps rank
+  // pairs), with and without LOD culling. The scalar kernel rounds like
+  // buildKDTree, so cells land on the same side of the threshold.
+  SetKDSimdLevel(KD_SIMD_SCALAR);
+  UpdateKDBatch(&batch);
+  Vector2 *treeSegments = malloc(2 * segmentTotal * sizeof(Vector2));
+  const float thresholds[] = {0.0f, 2.0f, 25.0f};
+  for (int k = 0; k < 3; k++) {
+    int expected = 0;
+    for (int t = 0; t < TREE_COUNT; t++) {
+      TreeNode *tree = buildKDTree(origin[t], target[t], kTreeSizes[t], 1,
+                                   NULL, batch.eased[t]);
+      expected += EmitKDTreeSegments(tree, kBounds, thresholds[k],
+                                     treeSegments + 2 * expected,
+                                     segmentTotal - expected);
+      freeTree(tree);
+    }
+    int n = EmitKDBatchSegments(&batch, thresholds[k], segments, segmentTotal);
+    CHECK(n == expected);
+    CHECK(SegmentsClose(segments, treeSegments, n < expected ? n : expected,
+                        1e-3f));
+    if (k == 0)
+      CHECK(n == segmentTotal);
+    else
+      CHECK(n < segmentTotal);
+  }
+  SetKDSimdLevel(best);
+
+  // A new transition over the same count reuses the slots
+  RandomPoints(target[4], kTreeSizes[4]);
+  CHECK(SetKDBatchTreePoints(&batch, 4, origin[4], target[4], kTreeSizes[4], 1));
+  CHECK(batch.progress[4] == 0.0f);
+  CHECK(!SetKDBatchTreePoints(&batch, 4, origin[4], target[4], 3, 1));
+
+  free(treeSegments);
+  free(segments);
+  free(reference);
+  FreeKDBatch(&batch);
+  return KD_TEST_RESULT();
+}
@@ -0,0 +1,57 @@
+#include "kd_test.h"
+#include "kdtree.h"
+#include <math.h>
+#include <stdlib.h>
+
+#define SMALL 20000
+#define LARGE 80000
+
+static const Rectangle kWindow = {0, 0, 800, 800};
+
+static TreeNode *RandomTree(Vector2 *points, int count) {
+  for (int i = 0; i < count; i++) {
+    points[i] = (Vector2){(float)(rand() % 80000) * 0.01f,
+                          (float)(rand() % 80000) * 0.01f};
+  }
+  return buildKDTree(points, points, count, 0, NULL, 1.0);
+}
+
+int main(void) {
+  srand(17);
+  Vector2 *points = malloc(LARGE * sizeof(Vector2));
+  Vector2 *segments = malloc(2 * LARGE * sizeof(Vector2));
+
+  // Without a threshold every node draws its line
+  TreeNode *small = RandomTree(points, SMALL);
+  CHECK(EmitKDTreeSegments(small, kWindow, 0.0f, segments, LARGE) == SMALL);
+
+  // With one, every emitted line spans at least the threshold and stays in
+  // the window
+  int smallCount = EmitKDTreeSegments(small, kWindow, 8.0f, segments, LARGE);
+  CHECK(smallCount > 0 && smallCount < SMALL);
+  bool inside = true;
+  for (int i = 0; i < smallCount; i++) {
+    Vector2 a = segments[2 * i];
+    Vector2 b = segments[2 * i + 1];
+    inside = inside && fabsf(a.x - b.x) + fabsf(a.y - b.y) >= 8.0f;
+    inside = inside && a.x >= 0 && a.y >= 0 && b.x <= 800 && b.y <= 800;
+  }
+  CHECK(inside);
+  freeTree(small);
+
+  // Four times the points barely changes the work: it depends on the window
+  TreeNode *large = RandomTree(points, LARGE);
+  int largeCount = EmitKDTreeSegments(large, kWindow, 8.0f, segments, LARGE);
+  CHECK(largeCount < smallCount * 13 / 10);
+
+  // A short buffer still reports the total and is not overrun
+  segments[20] = (Vector2){-1, -1};
+  CHECK(EmitKDTreeSegments(large, kWindow, 8.0f, segments, 10) == largeCount);
+  CHECK(segments[20].x == -1 && segments[20].y == -1);
+  freeTree(large);
+
+  CHECK(EmitKDTreeSegments(NULL, kWindow, 2.0f, segments, LARGE) == 0);
+  free(segments);
+  free(points);
+  return KD_TEST_RESULT();
+}
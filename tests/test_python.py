@@ -0,0 +1,103 @@
+"""Behaviour checks for the kdtree_native extension, run by ctest.
+
+Usage: test_python.py PATH_TO_MODULE. NumPy is optional: inputs are built
+with array/memoryview, which speak the same buffer protocol.
+"""
+import array
+import importlib.util
+import os
+import random
+import sys
+import tempfile
+import threading
+
+
+def load(path):
+    spec = importlib.util.spec_from_file_location("kdtree_native", path)
+    module = importlib.util.module_from_spec(spec)
+    spec.loader.exec_module(module)
+    return module
+
+
+def points(values):
+    """(n, 2) float32 buffer from a flat list of coordinates."""
+    flat = array.array("f", values)
+    return memoryview(flat).cast("B").cast("f", (len(values) // 2, 2))
+
+
+def image(width, height, fill):
+    return memoryview(bytearray([fill]) * (width * height)).cast(
+        "B", (height, width))
+
+
+def expect(error, call):
+    try:
+        call()
+    except error:
+        return
+    raise AssertionError("expected %s" % error.__name__)
+
+
+def main():
+    kd = load(sys.argv[1])
+    rng = random.Random(4)
+
+    # Re-initialising a tree replaces it while other threads keep querying
+    coords = [rng.uniform(0, 100) for _ in range(2 * 2000)]
+    tree = kd.KDTree(points(coords))
+    assert len(tree) == 2000
+    stop = threading.Event()
+    errors = []
+
+    def query():
+        while not stop.is_set():
+            n = tree.range_count(0, 0, 100, 100)
+            if n not in (2000, 3000):
+                errors.append(n)
+
+    reader = threading.Thread(target=query)
+    reader.start()
+    for i in range(20):
+        size = 2000 if i % 2 else 3000
+        tree.__init__(points([rng.uniform(0, 100) for _ in range(2 * size)]))
+    stop.set()
+    reader.join()
+    assert not errors, errors
+    assert len(tree) == 3000 - 1000 * (19 % 2)
+
+    # Interpolation outside [0, 1] is rejected and keeps the old tree
+    other = points([rng.uniform(0, 100) for _ in range(2 * 2000)])
+    for bad in (-0.1, 1.5, float("nan")):
+        expect(ValueError, lambda: tree.__init__(other, other, bad))
+    assert len(tree) == 2000
+    halfway = kd.KDTree(points(coords), other, 0.5, "cost")
+    assert len(halfway) == 2000
+
+    # Sampler argument checks raise ValueError, not MemoryError
+    expect(ValueError, lambda: kd.distribute_points(image(8, 8, 255), 10))
+    expect(ValueError, lambda: kd.distribute_points(image(8, 8, 0), 0))
+    expect(ValueError, lambda: kd.distribute_points(bytearray(16), 10))
+    sampled = memoryview(kd.distribute_points(image(8, 8, 0), 100))
+    assert sampled.shape == (64, 2) and sampled.format == "H"
+    assert sampled.itemsize == 2
+
+    # Snapshots: a missing file is an OSError, a damaged one a ValueError
+    expect(FileNotFoundError, lambda: kd.Snapshot("/nonexistent/tree.kds"))
+    with tempfile.TemporaryDirectory() as directory:
+        path = os.path.join(directory, "tree.kds")
+        tree.save(path)
+        snapshot = kd.Snapshot(path, verify=True)
+        assert len(snapshot) == len(tree)
+        for _ in range(20):
+            x, y = rng.uniform(0, 80), rng.uniform(0, 80)
+            assert (snapshot.range_count(x, y, 20, 20) ==
+                    tree.range_count(x, y, 20, 20))
+        del snapshot
+        with open(path, "r+b") as f:
+            f.write(b"XXXX")
+        expect(ValueError, lambda: kd.Snapshot(path))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,73 @@
+#include "alloc_track.h"
+#include "cpu_features.h"
+#include "kd_test.h"
+#include "qpoints.h"
+#include <stdlib.h>
+
+// Counts around the 4-point SSE2 step, so every tail length is decoded
+static const int kCounts[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 13, 1003};
+#define MAX_COUNT 1003
+
+int main(void) {
+  srand(23);
+  Vector2 decoded[MAX_COUNT];
+  KDSimdLevel best = GetKDSimdLevel();
+  for (size_t c = 0; c < sizeof(kCounts) / sizeof(kCounts[0]); c++) {
+    int count = kCounts[c];
+    QPointSet *set = AllocQPointSet(count, (Vector2){2.5f, 0.75f},
+                                    (Vector2){-3.0f, 100.0f});
+    CHECK(set != NULL && set->count == count);
+    for (int i = 0; i < count; i++) {
+      // Include both ends of the 16-bit range
+      set->points[i] = (QPoint){(uint16_t)(i == 0 ? 65535 : rand() % 65536),
+                                (uint16_t)(i == 1 ? 0 : rand() % 65536)};
+    }
+    // Every level decodes exactly offset + q * scale; the SSE2 kernel does
+    // the same multiply and add as the scalar loop
+    for (int level = KD_SIMD_SCALAR; level <= best; level++) {
+      SetKDSimdLevel((KDSimdLevel)level);
+      decoded[count - 1] = (Vector2){0, 0};
+      DecodeQPoints(set, decoded);
+      bool exact = true;
+      for (int i = 0; i < count; i++) {
+        exact = exact &&
+                decoded[i].x == -3.0f + (float)set->points[i].x * 2.5f &&
+                decoded[i].y == 100.0f + (float)set->points[i].y * 0.75f;
+      }
+      if (!exact) {
+        fprintf(stderr, "%s decode of %d points is off\n",
+                KDSimdLevelName((KDSimdLevel)level), count);
+        kdTestFailures++;
+      }
+    }
+    FreeQPointSet(set);
+  }
+  SetKDSimdLevel(best);
+
+  // Sampler pixels at the game's 2.5x window scale come back exactly
+  QPointSet *pixels = AllocQPointSet(3, (Vector2){2.5f, 2.5f}, (Vector2){0, 0});
+  pixels->points[0] = (QPoint){0, 0};
+  pixels->points[1] = (QPoint){319, 7};
+  pixels->points[2] = (QPoint){160, 320};
+  DecodeQPoints(pixels, decoded);
+  CHECK(decoded[1].x == 797.5f && decoded[1].y == 17.5f);
+  CHECK(decoded[2].x == 400.0f && decoded[2].y == 800.0f);
+
+  // Resampling strides when shrinking and repeats when padding
+  QPoint *shrunk = ResampleQPoints(pixels->points, 3, 2);
+  CHECK(shrunk != NULL && shrunk[0].x == 0 && shrunk[1].x == 319);
+  QPoint *padded = ResampleQPoints(pixels->points, 3, 7);
+  CHECK(padded != NULL && padded[0].x == 0 && padded[6].x == 160);
+  int seen[3] = {0};
+  for (int i = 0; padded && i < 7; i++) {
+    seen[padded[i].x == 0 ? 0 : (padded[i].x == 319 ? 1 : 2)]++;
+  }
+  CHECK(seen[0] >= 2 && seen[1] >= 2 && seen[2] >= 2);
+  CHECK(ResampleQPoints(pixels->points, 0, 4) == NULL);
+  CHECK(ResampleQPoints(pixels->points, 3, 0) == NULL);
+  KD_FREE(shrunk);
+  KD_FREE(padded);
+  FreeQPointSet(pixels);
+  FreeQPointSet(NULL);
+  return KD_TEST_RESULT();
+}
@@ -0,0 +1,77 @@
+#include "kd_test.h"
+#include "kdtree.h"
+#include <stdlib.h>
+
+#define COUNT 3000
+
+static float RandomCoord(void) {
+  // Coarse grid so many points share coordinates with range edges
+  return (float)(rand() % 400) * 0.5f;
+}
+
+static bool InRange(Vector2 p, Rectangle r) {
+  return p.x >= r.x && p.x <= r.x + r.width && p.y >= r.y &&
+         p.y <= r.y + r.height;
+}
+
+static int CompareXY(const void *a, const void *b) {
+  const Vector2 *p = a;
+  const Vector2 *q = b;
+  if (p->x != q->x)
+    return p->x < q->x ? -1 : 1;
+  if (p->y != q->y)
+    return p->y < q->y ? -1 : 1;
+  return 0;
+}
+
+int main(void) {
+  srand(2);
+  Vector2 *points = malloc(COUNT * sizeof(Vector2));
+  Vector2 *all = malloc(COUNT * sizeof(Vector2));
+  for (int i = 0; i < COUNT; i++) {
+    points[i] = (Vector2){RandomCoord(), RandomCoord()};
+    all[i] = points[i];
+  }
+  TreeNode *tree = buildKDTree(points, points, COUNT, 0, NULL, 1.0);
+  CHECK(tree != NULL && tree->count == COUNT);
+  CHECK(CountKDTreeRange(tree, (Rectangle){-1, -1, 500, 500}) == COUNT);
+
+  Vector2 *reported = malloc(COUNT * sizeof(Vector2));
+  Vector2 *expected = malloc(COUNT * sizeof(Vector2));
+  for (int q = 0; q < 300; q++) {
+    Rectangle r = {RandomCoord() - 10, RandomCoord() - 10,
+                   (float)(rand() % 120), (float)(rand() % 120)};
+    int brute = 0;
+    for (int i = 0; i < COUNT; i++) {
+      if (InRange(all[i], r))
+        expected[brute++] = all[i];
+    }
+    CHECK(CountKDTreeRange(tree, r) == brute);
+
+    // Reported points are exactly the brute-force set
+    int n = ReportKDTreeRange(tree, r, reported, COUNT);
+    CHECK(n == brute);
+    qsort(reported, n, sizeof(Vector2), CompareXY);
+    qsort(expected, brute, sizeof(Vector2), CompareXY);
+    bool same = true;
+    for (int i = 0; i < n && i < brute; i++) {
+      same = same && CompareXY(&reported[i], &expected[i]) == 0;
+    }
+    CHECK(same);
+
+    // A short buffer still gets the full total
+    if (brute > 2)
+      CHECK(ReportKDTreeRange(tree, r, reported, 2) == brute);
+  }
+
+  // Queries on nothing
+  CHECK(CountKDTreeRange(NULL, (Rectangle){0, 0, 10, 10}) == 0);
+  CHECK(CountKDTreeRange(tree, (Rectangle){-100, -100, 10, 10}) == 0);
+
+  freeTree(tree);
+  free(points);
+  free(all);
+  free(reported);
+  free(expected);
+  return KD_TEST_RESULT();
+}
@@ -0,0 +1,197 @@
+#include "kd_batch.h"
+#include "kd_test.h"
+#include "kdtree.h"
+#include "qpoints.h"
+#include "replay.h"
+#include "simplex.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define POINTS 700
+#define FRAMES 40
+#define PATH "test_replay.kdrp"
+#define SEED 77u
+
+static const Rectangle kWindow = {0, 0, 800, 800};
+
+// FNV-1a over a frame's segments, so two runs can be compared exactly
+static unsigned HashSegments(const Vector2 *segments, int n) {
+  unsigned hash = 2166136261u;
+  const unsigned char *bytes = (const unsigned char *)segments;
+  for (size_t i = 0; i < (size_t)n * 2 * sizeof(Vector2); i++) {
+    hash = (hash ^ bytes[i]) * 16777619u;
+  }
+  return hash;
+}
+
+static unsigned HashTreeFrame(Vector2 *origin, Vector2 *target,
+                              float interpolation, int policy,
+                              Vector2 *segments) {
+  KDBuildOptions options = {.policy = (KDSplitPolicy)policy,
+                            .bounds = kWindow};
+  TreeNode *tree = buildKDTreeEx(origin, target, POINTS, 1, NULL,
+                                 interpolation, &options);
+  int n = EmitKDTreeSegments(tree, kWindow, 2.0f, segments, POINTS);
+  freeTree(tree);
+  return HashSegments(segments, n);
+}
+
+// The game's median path: the batch holds the current transition
+static unsigned HashBatchFrame(KDBatch *batch, float progress,
+                               float jitterTime, float *scratch,
+                               Vector2 *segments) {
+  SetKDBatchTreeProgress(batch, 0, progress);
+  UpdateKDBatch(batch);
+  if (jitterTime >= 0.0f)
+    JitterKDBatchSplits(batch, scratch, jitterTime, 4.0f);
+  return HashSegments(segments,
+                      EmitKDBatchSegments(batch, 2.0f, segments, POINTS));
+}
+
+// Replay the file the way kdtree_replay does and hash every frame
+static int ReplayHashes(unsigned *hashes, Vector2 *sets[3]) {
+  ReplayFile replay;
+  if (!OpenReplayReader(&replay, PATH))
+    return -1;
+  static Vector2 origin[POINTS], target[POINTS], segments[2 * POINTS];
+  static float scratch[3 * (POINTS + 4)];
+  KDBatch batch;
+  InitKDBatch(&batch);
+  int received = 0;
+  int frames = 0;
+  for (;;) {
+    ReplayEvent event = ReadReplayEvent(&replay);
+    if (event.type == REPLAY_END)
+      break;
+    if (event.type == REPLAY_ERROR) {
+      frames = -1;
+      break;
+    }
+    if (event.type == REPLAY_NOISE_SEED) {
+      CHECK(event.seed == SEED);
+      simplex1d_init_seed(event.seed);
+      continue;
+    }
+    if (event.type == REPLAY_POINT_SET) {
+      if (received < 3)
+        CHECK(memcmp(event.points, sets[received], sizeof(origin)) == 0);
+      if (received >= 2)
+        memcpy(origin, target, sizeof(origin));
+      memcpy(received == 0 ? origin : target, event.points, sizeof(origin));
+      received++;
+      if (received == 2)
+        CHECK(AddKDBatchTree(&batch, origin, target, POINTS, 1, kWindow) == 0);
+      else if (received > 2)
+        CHECK(SetKDBatchTreePoints(&batch, 0, origin, target, POINTS, 1));
+      continue;
+    }
+    hashes[frames++] =
+        event.progress >= 0.0f
+            ? HashBatchFrame(&batch, event.progress, event.jitterTime,
+                             scratch, segments)
+            : HashTreeFrame(origin, target, event.interpolation,
+                            event.splitPolicy, segments);
+  }
+  FreeKDBatch(&batch);
+  CloseReplay(&replay);
+  return frames;
+}
+
+int main(void) {
+  srand(19);
+  static Vector2 grid[POINTS], sampled[POINTS], next[POINTS];
+  static Vector2 origin[POINTS], target[POINTS], segments[2 * POINTS];
+  static float scratch[3 * (POINTS + 4)];
+  QPointSet *quantized =
+      AllocQPointSet(POINTS, (Vector2){2.5f, 2.5f}, (Vector2){0, 0});
+  CHECK(quantized != NULL);
+  for (int i = 0; i < POINTS; i++) {
+    grid[i] = (Vector2){(float)(i % 27) * 30.0f, (float)(i / 27) * 30.0f};
+    quantized->points[i] = (QPoint){(uint16_t)(rand() % 320),
+                                    (uint16_t)(rand() % 320)};
+    next[i] = (Vector2){(float)(rand() % 800), (float)(rand() % 800)};
+  }
+  DecodeQPoints(quantized, sampled);
+
+  // Record the game's hand-over: grid -> quantized set -> float set, with
+  // every split policy, median frames drawn from a batch (some jittered),
+  // hashing each frame as it is "drawn"
+  ReplayFile recording;
+  CHECK(OpenReplayWriter(&recording, PATH, POINTS));
+  CHECK(WriteReplayPointSet(&recording, grid));
+  CHECK(WriteReplayQPointSet(&recording, quantized));
+  simplex1d_init_seed(SEED);
+  CHECK(WriteReplayNoiseSeed(&recording, SEED));
+  memcpy(origin, grid, sizeof(origin));
+  memcpy(target, sampled, sizeof(target));
+  KDBatch batch;
+  InitKDBatch(&batch);
+  CHECK(AddKDBatchTree(&batch, origin, target, POINTS, 1, kWindow) == 0);
+  CHECK(3 * batch.slotCount <= (int)(sizeof(scratch) / sizeof(float)));
+  unsigned live[FRAMES];
+  int batchFrames = 0;
+  int jitterChanged = 0;
+  for (int f = 0; f < FRAMES; f++) {
+    if (f == FRAMES / 2) {
+      CHECK(WriteReplayPointSet(&recording, next));
+      memcpy(origin, target, sizeof(origin));
+      memcpy(target, next, sizeof(target));
+      CHECK(SetKDBatchTreePoints(&batch, 0, origin, target, POINTS, 1));
+    }
+    float progress = (float)(f % (FRAMES / 2)) / (FRAMES / 2 - 1);
+    int policy = f % KD_SPLIT_POLICY_COUNT;
+    if (policy == KD_SPLIT_MEDIAN) {
+      float jitterTime = f % 8 == 0 ? f * 0.37f : -1.0f;
+      CHECK(WriteReplayFrame(&recording, progress, policy, progress,
+                             jitterTime));
+      live[f] = HashBatchFrame(&batch, progress, jitterTime, scratch,
+                               segments);
+      if (jitterTime >= 0.0f)
+        jitterChanged +=
+            live[f] != HashBatchFrame(&batch, progress, -1.0f, scratch,
+                                      segments);
+      batchFrames++;
+    } else {
+      CHECK(WriteReplayFrame(&recording, progress, policy, -1.0f, -1.0f));
+      live[f] = HashTreeFrame(origin, target, progress, policy, segments);
+    }
+  }
+  CHECK(CloseReplay(&recording));
+  FreeKDBatch(&batch);
+  FreeQPointSet(quantized);
+  CHECK(batchFrames > 0 && jitterChanged > 0);
+
+  // Two replays reproduce every frame of the recorded run exactly, the
+  // jittered batch frames included
+  unsigned first[FRAMES + 1], second[FRAMES + 1];
+  Vector2 *sets[3] = {grid, sampled, next};
+  CHECK(ReplayHashes(first, sets) == FRAMES);
+  CHECK(ReplayHashes(second, sets) == FRAMES);
+  CHECK(memcmp(first, live, sizeof(live)) == 0);
+  CHECK(memcmp(second, live, sizeof(live)) == 0);
+
+  // A truncated recording reports an error instead of a short replay
+  FILE *file = fopen(PATH, "rb");
+  CHECK(file != NULL);
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  rewind(file);
+  char *bytes = malloc(size);
+  CHECK(fread(bytes, 1, size, file) == (size_t)size);
+  fclose(file);
+  file = fopen(PATH, "wb");
+  fwrite(bytes, 1, size - 3, file);
+  fclose(file);
+  CHECK(ReplayHashes(first, sets) == -1);
+
+  // And a file that is not a recording does not open
+  memcpy(bytes, "XXXX", 4);
+  file = fopen(PATH, "wb");
+  fwrite(bytes, 1, size, file);
+  fclose(file);
+  ReplayFile replay;
+  CHECK(!OpenReplayReader(&replay, PATH));
+  free(bytes);
+  remove(PATH);
+  return KD_TEST_RESULT();
+}
@@ -0,0 +1,107 @@
+#include "alloc_track.h"
+#include "kd_test.h"
+#include "kdtree.h"
+#include "reject_sampling.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SIZE 320
+
+static double Seconds(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// A thick ring with a soft edge, about as many dark pixels as a glyph mask
+static void DrawRing(unsigned char *pixels) {
+  for (int y = 0; y < SIZE; y++) {
+    for (int x = 0; x < SIZE; x++) {
+      float r = hypotf(x - SIZE / 2.0f, y - SIZE / 2.0f);
+      float edge = fabsf(r - 100.0f) - 10.0f; // < 0 inside the ring
+      float ink = edge <= 0.0f ? 1.0f : (edge < 3.0f ? 1.0f - edge / 3.0f : 0.0f);
+      pixels[y * SIZE + x] = (unsigned char)(255.0f - 255.0f * ink);
+    }
+  }
+}
+
+static bool AllDarkAndSpaced(const GrayImage *img, const Point *points, int n,
+                             float min_distance) {
+  for (int i = 0; i < n; i++) {
+    if (points[i].x >= img->width || points[i].y >= img->height ||
+        img->data[points[i].y * img->width + points[i].x] == 255)
+      return false;
+    for (int j = i + 1; j < n; j++) {
+      int dx = points[i].x - points[j].x;
+      int dy = points[i].y - points[j].y;
+      if (dx * dx + dy * dy < min_distance * min_distance)
+        return false;
+    }
+  }
+  return true;
+}
+
+int main(void) {
+  srand(1);
+  unsigned char *pixels = malloc(SIZE * SIZE);
+  DrawRing(pixels);
+  GrayImage img = {pixels, SIZE, SIZE};
+  int available = 0;
+  for (int i = 0; i < SIZE * SIZE; i++) {
+    available += pixels[i] < 255;
+  }
+
+  // Asking for more points than dark pixels returns every dark pixel at once
+  int n = 0;
+  double start = Seconds();
+  Point *points = distribute_points_on_gray(&img, 250000, 1.0f, &n);
+  double saturated = Seconds() - start;
+  CHECK(points != NULL);
+  CHECK(n == available);
+  CHECK(saturated < 0.5);
+  CHECK(AllDarkAndSpaced(&img, points, n, 1.0f));
+  KD_FREE(points);
+
+  // Just under saturation still terminates quickly with distinct pixels
+  start = Seconds();
+  points = distribute_points_on_gray(&img, available * 9 / 10, 1.0f, &n);
+  CHECK(Seconds() - start < 2.0);
+  CHECK(points != NULL);
+  CHECK(n > available / 2 && n <= available * 9 / 10);
+  CHECK(AllDarkAndSpaced(&img, points, n, 1.0f));
+  KD_FREE(points);
+
+  // A sparse request keeps its spacing
+  points = distribute_points_on_gray(&img, 400, 4.0f, &n);
+  CHECK(points != NULL);
+  CHECK(n == 400);
+  CHECK(AllDarkAndSpaced(&img, points, n, 4.0f));
+
+  // Resampling pads or strides to exactly the requested count
+  QPoint *padded = ResampleQPoints(points, n, 1023);
+  CHECK(padded != NULL);
+  CHECK(padded[0].x == points[0].x && padded[0].y == points[0].y);
+  CHECK(padded[1022].x == points[n - 1].x && padded[1022].y == points[n - 1].y);
+  QPoint *strided = ResampleQPoints(points, n, 100);
+  CHECK(strided[99].x == points[396].x && strided[99].y == points[396].y);
+  CHECK(ResampleQPoints(points, n, 0) == NULL);
+  KD_FREE(padded);
+  KD_FREE(strided);
+  KD_FREE(points);
+
+  Vector2 grid[3] = {{0, 0}, {1, 1}, {2, 2}};
+  Vector2 *more = ResamplePoints(grid, 3, 7);
+  CHECK(more != NULL && more[6].x == 2.0f && more[3].x == 1.0f);
+  KD_FREE(more);
+
+  // Blank or invalid images produce nothing
+  memset(pixels, 255, SIZE * SIZE);
+  CHECK(distribute_points_on_gray(&img, 10, 1.0f, &n) == NULL && n == 0);
+  GrayImage empty = {NULL, 0, 0};
+  CHECK(distribute_points_on_gray(&empty, 10, 1.0f, &n) == NULL && n == 0);
+
+  free(pixels);
+  return KD_TEST_RESULT();
+}
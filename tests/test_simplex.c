@@ -0,0 +1,70 @@
+#include "cpu_features.h"
+#include "kd_test.h"
+#include "simplex.h"
+#include <math.h>
+#include <stdlib.h>
+
+// Counts below, at and past the 4 and 8 lane widths so every kernel runs
+// with and without a scalar tail
+static const int kCounts[] = {1, 3, 4, 5, 7, 8, 9, 13, 1003};
+#define MAX_COUNT 1003
+
+static float x[MAX_COUNT], y[MAX_COUNT], batch[MAX_COUNT];
+
+// Batch results at the current dispatch level against the scalar functions
+static bool MatchesScalar(int count, int octaves) {
+  bool same = true;
+  fractal_simplex1d_batch(x, batch, count, octaves, 0.5f);
+  for (int i = 0; i < count; i++) {
+    same = same &&
+           fabsf(batch[i] - fractal_simplex1d(x[i], octaves, 0.5f)) <= 1e-5f;
+  }
+  fractal_simplex2d_batch(x, y, batch, count, octaves, 0.5f);
+  for (int i = 0; i < count; i++) {
+    same = same && fabsf(batch[i] - fractal_simplex2d(x[i], y[i], octaves,
+                                                      0.5f)) <= 1e-5f;
+  }
+  if (octaves == 1) {
+    simplex1d_batch(x, batch, count);
+    for (int i = 0; i < count; i++) {
+      same = same && fabsf(batch[i] - simplex1d(x[i])) <= 1e-5f;
+    }
+    simplex2d_batch(x, y, batch, count);
+    for (int i = 0; i < count; i++) {
+      same = same && fabsf(batch[i] - simplex2d(x[i], y[i])) <= 1e-5f;
+    }
+  }
+  return same;
+}
+
+int main(void) {
+  simplex1d_init();
+  srand(11);
+  for (int i = 0; i < MAX_COUNT; i++) {
+    // Negative coordinates and exact integers exercise the vector floor
+    x[i] = i % 17 == 0 ? (float)(i / 17 - 30)
+                       : (float)(rand() % 20000 - 10000) * 0.01f;
+    y[i] = (float)(rand() % 20000 - 10000) * 0.013f;
+  }
+
+  KDSimdLevel best = GetKDSimdLevel();
+  for (int level = KD_SIMD_SCALAR; level <= best; level++) {
+    CHECK(SetKDSimdLevel((KDSimdLevel)level) == (KDSimdLevel)level);
+    for (size_t c = 0; c < sizeof(kCounts) / sizeof(kCounts[0]); c++) {
+      for (int octaves = 1; octaves <= 4; octaves += 3) {
+        if (!MatchesScalar(kCounts[c], octaves)) {
+          fprintf(stderr, "%s batch differs from scalar: count %d, octaves %d\n",
+                  KDSimdLevelName((KDSimdLevel)level), kCounts[c], octaves);
+          kdTestFailures++;
+        }
+      }
+    }
+  }
+  SetKDSimdLevel(best);
+
+  // A zero count touches nothing
+  batch[0] = 42.0f;
+  fractal_simplex2d_batch(x, y, batch, 0, 3, 0.5f);
+  CHECK(batch[0] == 42.0f);
+  return KD_TEST_RESULT();
+}
@@ -0,0 +1,205 @@
+#include "kd_snapshot.h"
+#include "kd_test.h"
+#include "kdtree.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define COUNT 3000
+#define PATH "test_snapshot.kds"
+
+static const Rectangle kWindow = {0, 0, 800, 800};
+
+// Preorder walk comparing every field with the node at the same index
+static int CompareNodes(const TreeNode *node, const KDSnapshot *snapshot,
+                        int index, bool *ok) {
+  if (node == NULL)
+    return -1;
+  if (index < 0 || index >= snapshot->nodeCount) {
+    *ok = false;
+    return -1;
+  }
+  const KDSnapshotNode *flat = &snapshot->nodes[index];
+  *ok = *ok && flat->point.x == node->point.x &&
+        flat->point.y == node->point.y &&
+        flat->boundsMin.x == node->boundsMin.x &&
+        flat->boundsMin.y == node->boundsMin.y &&
+        flat->boundsMax.x == node->boundsMax.x &&
+        flat->boundsMax.y == node->boundsMax.y &&
+        flat->count == node->count && flat->dimension == node->dimension &&
+        !(flat->flags & KD_SNAPSHOT_DELETED) == !node->deleted;
+  int left = KDSnapshotLeftChild(snapshot, index);
+  int right = KDSnapshotRightChild(snapshot, index);
+  *ok = *ok && (left >= 0) == (node->left != NULL) &&
+        (right >= 0) == (node->right != NULL);
+  CompareNodes(node->left, snapshot, left, ok);
+  CompareNodes(node->right, snapshot, right, ok);
+  return index;
+}
+
+static long ReadFile(char **bytes) {
+  FILE *file = fopen(PATH, "rb");
+  if (file == NULL)
+    return -1;
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  rewind(file);
+  *bytes = malloc(size);
+  if (fread(*bytes, 1, size, file) != (size_t)size)
+    size = -1;
+  fclose(file);
+  return size;
+}
+
+static void WriteFile(const char *bytes, long size) {
+  FILE *file = fopen(PATH, "wb");
+  fwrite(bytes, 1, size, file);
+  fclose(file);
+}
+
+// Write `count` hand-made nodes behind a copy of the header at `file` (a
+// snapshot read back whole); the checksum is left stale
+static void WriteNodes(const char *file, const KDSnapshotNode *nodes,
+                       uint32_t count) {
+  KDSnapshotHeader header;
+  memcpy(&header, file, sizeof(header));
+  header.nodeCount = count;
+  FILE *out = fopen(PATH, "wb");
+  fwrite(&header, sizeof(header), 1, out);
+  fwrite(nodes, sizeof(KDSnapshotNode), count, out);
+  fclose(out);
+}
+
+int main(void) {
+  srand(29);
+  static Vector2 points[COUNT], fromTree[2 * COUNT], fromSnapshot[2 * COUNT];
+  for (int i = 0; i < COUNT; i++) {
+    points[i] = (Vector2){(float)(rand() % 80000) * 0.01f,
+                          (float)(rand() % 80000) * 0.01f};
+  }
+  TreeNode *tree = buildKDTree(points, points, COUNT, 0, NULL, 1.0);
+  // Tombstones are saved too
+  for (int i = 0; i < COUNT; i += 7) {
+    tree = DeleteKDTree(tree, points[i]);
+  }
+
+  // Round trip: same nodes, same query and drawing results, no tmp left
+  CHECK(WriteKDSnapshot(tree, PATH));
+  CHECK(fopen(PATH ".tmp", "rb") == NULL);
+  KDSnapshot snapshot;
+  CHECK(LoadKDSnapshot(&snapshot, PATH, true));
+  CHECK(snapshot.nodeCount == COUNT);
+  bool same = true;
+  CompareNodes(tree, &snapshot, 0, &same);
+  CHECK(same);
+  const Rectangle ranges[] = {kWindow, {100, 200, 300, 50}, {-5, -5, 1, 1}};
+  for (int r = 0; r < 3; r++) {
+    CHECK(CountKDSnapshotRange(&snapshot, ranges[r]) ==
+          CountKDTreeRange(tree, ranges[r]));
+  }
+  int treeSegments =
+      EmitKDTreeSegments(tree, kWindow, 4.0f, fromTree, COUNT);
+  CHECK(EmitKDSnapshotSegments(&snapshot, kWindow, 4.0f, fromSnapshot,
+                               COUNT) == treeSegments);
+  CHECK(memcmp(fromTree, fromSnapshot,
+               (size_t)treeSegments * 2 * sizeof(Vector2)) == 0);
+  UnloadKDSnapshot(&snapshot);
+
+  char *bytes = NULL;
+  long size = ReadFile(&bytes);
+  CHECK(size == (long)(sizeof(KDSnapshotHeader) +
+                       COUNT * sizeof(KDSnapshotNode)));
+  KDSnapshotNode *nodes = (KDSnapshotNode *)(bytes + sizeof(KDSnapshotHeader));
+  int parent = 0;
+  while (!(nodes[parent].flags & KD_SNAPSHOT_HAS_RIGHT)) {
+    parent++;
+  }
+
+  // A flipped point bit is caught by the checksum, and only when asked for
+  nodes[COUNT / 2].point.x += 1.0f;
+  WriteFile(bytes, size);
+  CHECK(!LoadKDSnapshot(&snapshot, PATH, true) && errno == 0);
+  CHECK(LoadKDSnapshot(&snapshot, PATH, false));
+  UnloadKDSnapshot(&snapshot);
+  nodes[COUNT / 2].point.x -= 1.0f;
+
+  // Child offsets are rejected without the checksum: past the end, back to
+  // the parent itself, shared with the left child, inside the left subtree,
+  // skipping a node, and a left child on the last node
+  uint32_t right = nodes[parent].right;
+  const uint32_t badRight[] = {COUNT,      0xffffffffu, (uint32_t)parent,
+                               parent + 1, right - 1,   right + 1};
+  for (int b = 0; b < 6; b++) {
+    nodes[parent].right = badRight[b];
+    WriteFile(bytes, size);
+    CHECK(!LoadKDSnapshot(&snapshot, PATH, false) && errno == 0);
+    CHECK(snapshot.nodes == NULL);
+  }
+  nodes[parent].right = right;
+  nodes[COUNT - 1].flags |= KD_SNAPSHOT_HAS_LEFT;
+  WriteFile(bytes, size);
+  CHECK(!LoadKDSnapshot(&snapshot, PATH, false));
+  nodes[COUNT - 1].flags &= ~KD_SNAPSHOT_HAS_LEFT;
+
+  // 40 nodes whose left and right child are both the next node: every node
+  // is reached twice, which would make a query walk 2^40 paths
+  static KDSnapshotNode synthetic[KD_SNAPSHOT_MAX_DEPTH + 1];
+  for (int i = 0; i < 40; i++) {
+    synthetic[i] = nodes[i];
+    synthetic[i].flags = i < 39 ? KD_SNAPSHOT_HAS_LEFT | KD_SNAPSHOT_HAS_RIGHT
+                                : 0;
+    synthetic[i].right = (uint32_t)i + 1;
+  }
+  WriteNodes(bytes, synthetic, 40);
+  CHECK(!LoadKDSnapshot(&snapshot, PATH, false) && errno == 0);
+  // A node no parent points at
+  synthetic[0].flags = KD_SNAPSHOT_HAS_LEFT;
+  synthetic[1].flags = 0;
+  synthetic[2].flags = 0;
+  WriteNodes(bytes, synthetic, 3);
+  CHECK(!LoadKDSnapshot(&snapshot, PATH, false));
+
+  // A chain of left children loads up to KD_SNAPSHOT_MAX_DEPTH levels
+  for (int i = 0; i <= KD_SNAPSHOT_MAX_DEPTH; i++) {
+    synthetic[i] = nodes[0];
+    synthetic[i].flags = KD_SNAPSHOT_HAS_LEFT;
+  }
+  synthetic[KD_SNAPSHOT_MAX_DEPTH - 1].flags = 0;
+  WriteNodes(bytes, synthetic, KD_SNAPSHOT_MAX_DEPTH);
+  CHECK(LoadKDSnapshot(&snapshot, PATH, false));
+  UnloadKDSnapshot(&snapshot);
+  synthetic[KD_SNAPSHOT_MAX_DEPTH - 1].flags = KD_SNAPSHOT_HAS_LEFT;
+  synthetic[KD_SNAPSHOT_MAX_DEPTH].flags = 0;
+  WriteNodes(bytes, synthetic, KD_SNAPSHOT_MAX_DEPTH + 1);
+  CHECK(!LoadKDSnapshot(&snapshot, PATH, false) && errno == 0);
+
+  // and the writer refuses a deeper tree instead of writing one that
+  // cannot be loaded
+  static TreeNode chain[KD_SNAPSHOT_MAX_DEPTH + 1];
+  for (int i = 0; i <= KD_SNAPSHOT_MAX_DEPTH; i++) {
+    chain[i] = (TreeNode){.point = {1, 1}, .count = 1, .size = 1,
+                          .left = i < KD_SNAPSHOT_MAX_DEPTH ? &chain[i + 1]
+                                                            : NULL};
+  }
+  CHECK(!WriteKDSnapshot(chain, PATH) && errno == EINVAL);
+  CHECK(fopen(PATH ".tmp", "rb") == NULL);
+
+  // A truncated file is rejected too
+  WriteFile(bytes, size - 5);
+  CHECK(!LoadKDSnapshot(&snapshot, PATH, false));
+
+  // Rewriting replaces the damaged file in place
+  CHECK(WriteKDSnapshot(tree, PATH));
+  CHECK(LoadKDSnapshot(&snapshot, PATH, true));
+  UnloadKDSnapshot(&snapshot);
+
+  // A write that cannot create its tmp file fails and leaves nothing behind
+  CHECK(!WriteKDSnapshot(tree, "no_such_dir/" PATH));
+  errno = 0;
+  CHECK(!LoadKDSnapshot(&snapshot, "no_such_dir/" PATH, false) && errno != 0);
+
+  free(bytes);
+  freeTree(tree);
+  remove(PATH);
+  return KD_TEST_RESULT();
+}
@@ -0,0 +1,123 @@
+#include "kd_test.h"
+#include "kdtree.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define COUNT 4000
+
+static const Rectangle kBounds = {0, 0, 800, 800};
+
+// Every point of the left subtree lies at or before the node's split and
+// every point of the right subtree at or after it. Returns the node count.
+static int CheckSubtree(const TreeNode *node, Vector2 lo, Vector2 hi,
+                        bool *ok) {
+  if (node == NULL)
+    return 0;
+  Vector2 p = node->point;
+  if (p.x < lo.x || p.x > hi.x || p.y < lo.y || p.y > hi.y)
+    *ok = false;
+  Vector2 leftHi = hi;
+  Vector2 rightLo = lo;
+  if (node->dimension == 0) {
+    leftHi.x = p.x;
+    rightLo.x = p.x;
+  } else {
+    leftHi.y = p.y;
+    rightLo.y = p.y;
+  }
+  int left = CheckSubtree(node->left, lo, leftHi, ok);
+  int right = CheckSubtree(node->right, rightLo, hi, ok);
+  if (node->count != left + right + 1)
+    *ok = false;
+  return left + right + 1;
+}
+
+// Reference for the cost policy's root: sort copies on each axis, pair by
+// rank and price the same sampled planes
+static int CostRootDimension(const Vector2 *origin, const Vector2 *target,
+                             float interpolation, float *outSplit) {
+  static Vector2 o[COUNT], t[COUNT];
+  const int samples = 16;
+  float bestCost = INFINITY;
+  int bestDimension = 0;
+  for (int d = 0; d < 2; d++) {
+    memcpy(o, origin, sizeof(o));
+    memcpy(t, target, sizeof(t));
+    qsort(o, COUNT, sizeof(Vector2), d == 0 ? CompareX : CompareY);
+    qsort(t, COUNT, sizeof(Vector2), d == 0 ? CompareX : CompareY);
+    for (int s = 0; s <= samples + 1; s++) {
+      int rank = (int)((long long)s * (COUNT - 1) / (samples + 1));
+      float oc = d == 0 ? o[rank].x : o[rank].y;
+      float tc = d == 0 ? t[rank].x : t[rank].y;
+      float split = oc + interpolation * (tc - oc);
+      float extent = d == 0 ? kBounds.width : kBounds.height;
+      float other = d == 0 ? kBounds.height : kBounds.width;
+      float leftExtent = fminf(fmaxf(split, 0.0f), extent);
+      float cost = other * (leftExtent * rank +
+                            (extent - leftExtent) * (COUNT - rank - 1));
+      if (cost < bestCost) {
+        bestCost = cost;
+        bestDimension = d;
+        *outSplit = split;
+      }
+    }
+  }
+  return bestDimension;
+}
+
+int main(void) {
+  srand(13);
+  static Vector2 origin[COUNT], target[COUNT];
+  for (int i = 0; i < COUNT; i++) {
+    // Few distinct x values in the origin and y values in the target, so
+    // every policy meets runs of equal coordinates
+    origin[i] = (Vector2){(float)(rand() % 40) * 20.0f,
+                          (float)(rand() % 1600) * 0.5f};
+    target[i] = (Vector2){(float)(rand() % 1600) * 0.25f + 200.0f,
+                          (float)(rand() % 25) * 32.0f};
+  }
+
+  const float interpolations[] = {0.0f, 0.3f, 1.0f};
+  for (int policy = 0; policy < KD_SPLIT_POLICY_COUNT; policy++) {
+    for (int k = 0; k < 3; k++) {
+      KDBuildOptions options = {.policy = (KDSplitPolicy)policy,
+                                .bounds = kBounds};
+      TreeNode *tree = buildKDTreeEx(origin, target, COUNT, 1, NULL,
+                                     interpolations[k], &options);
+      bool ok = true;
+      int nodes = CheckSubtree(tree, (Vector2){-INFINITY, -INFINITY},
+                               (Vector2){INFINITY, INFINITY}, &ok);
+      if (!ok || nodes != COUNT) {
+        fprintf(stderr, "%s split at %.1f breaks the kd invariant\n",
+                KDSplitPolicyName((KDSplitPolicy)policy), interpolations[k]);
+        kdTestFailures++;
+      }
+      KDTreeStats stats = GetKDTreeStats(tree);
+      CHECK(stats.nodes == COUNT && stats.depth >= 12);
+      CHECK(CountKDTreeRange(tree, kBounds) == COUNT);
+
+      if (policy == KD_SPLIT_MEDIAN) {
+        CHECK(tree->dimension == 1 && stats.depth == 12);
+      } else if (policy == KD_SPLIT_COST) {
+        float split = 0.0f;
+        int dimension =
+            CostRootDimension(origin, target, interpolations[k], &split);
+        CHECK(tree->dimension == dimension);
+        CHECK((dimension == 0 ? tree->point.x : tree->point.y) == split);
+      }
+      freeTree(tree);
+    }
+  }
+
+  // Denser plane sampling still builds a valid tree
+  KDBuildOptions dense = {.policy = KD_SPLIT_COST, .bounds = kBounds,
+                          .costSamples = 200};
+  TreeNode *tree = buildKDTreeEx(origin, target, COUNT, 0, NULL, 0.5, &dense);
+  bool ok = true;
+  CHECK(CheckSubtree(tree, (Vector2){-INFINITY, -INFINITY},
+                     (Vector2){INFINITY, INFINITY}, &ok) == COUNT);
+  CHECK(ok);
+  freeTree(tree);
+  return KD_TEST_RESULT();
+}
@@ -0,0 +1,96 @@
+#include "kd_test.h"
+#include "kdtree.h"
+#include <math.h>
+#include <stdlib.h>
+
+#define MAX_POINTS 4000
+
+static Vector2 live[MAX_POINTS];
+static int liveCount = 0;
+
+static int BruteCount(Rectangle r) {
+  int n = 0;
+  for (int i = 0; i < liveCount; i++) {
+    n += live[i].x >= r.x && live[i].x <= r.x + r.width && live[i].y >= r.y &&
+         live[i].y <= r.y + r.height;
+  }
+  return n;
+}
+
+static bool MatchesBruteForce(const TreeNode *tree) {
+  if ((tree ? tree->count : 0) != liveCount)
+    return false;
+  for (int q = 0; q < 20; q++) {
+    Rectangle r = {(float)(rand() % 100) - 5, (float)(rand() % 100) - 5,
+                   (float)(rand() % 40), (float)(rand() % 40)};
+    if (CountKDTreeRange(tree, r) != BruteCount(r))
+      return false;
+  }
+  return true;
+}
+
+int main(void) {
+  srand(3);
+
+  // Random inserts and deletes on a small grid, so duplicates and points on
+  // split planes are common
+  TreeNode *tree = NULL;
+  bool consistent = true;
+  for (int step = 0; step < 12000; step++) {
+    if (liveCount < MAX_POINTS && (liveCount == 0 || rand() % 3 != 0)) {
+      Vector2 p = {(float)(rand() % 90), (float)(rand() % 90)};
+      tree = InsertKDTree(tree, p);
+      live[liveCount++] = p;
+    } else {
+      int victim = rand() % liveCount;
+      tree = DeleteKDTree(tree, live[victim]);
+      live[victim] = live[--liveCount];
+    }
+    if (step % 100 == 0)
+      consistent = consistent && MatchesBruteForce(tree);
+  }
+  CHECK(consistent);
+  CHECK(MatchesBruteForce(tree));
+
+  // Deleting a point that is not there changes nothing
+  int before = tree->count;
+  tree = DeleteKDTree(tree, (Vector2){-1.0f, -1.0f});
+  CHECK(tree->count == before);
+
+  // Empty the tree completely
+  while (liveCount > 0) {
+    tree = DeleteKDTree(tree, live[--liveCount]);
+  }
+  CHECK(tree == NULL || tree->count == 0);
+  freeTree(tree);
+
+  // Sorted inserts stay logarithmic in depth thanks to scapegoat rebuilds
+  tree = NULL;
+  for (int i = 0; i < 20000; i++) {
+    tree = InsertKDTree(tree, (Vector2){(float)i, (float)i * 0.5f});
+  }
+  KDTreeStats stats = GetKDTreeStats(tree);
+  CHECK(tree->count == 20000);
+  CHECK(stats.depth <= (int)ceil(log(20000.0) / log(1.0 / 0.7)) + 2);
+  CHECK(CountKDTreeRange(tree, (Rectangle){100, 0, 99, 20000}) == 100);
+  freeTree(tree);
+
+  // Every point of an interpolated build can be found and deleted again
+  Vector2 origin[500];
+  Vector2 target[500];
+  for (int i = 0; i < 500; i++) {
+    origin[i] = (Vector2){(float)(rand() % 50), (float)(rand() % 50)};
+    target[i] = (Vector2){(float)(rand() % 50), (float)(rand() % 50)};
+  }
+  tree = buildKDTree(origin, target, 500, 0, NULL, 0.37);
+  Vector2 built[500];
+  CHECK(ReportKDTreeRange(tree, (Rectangle){-1, -1, 60, 60}, built, 500) ==
+        500);
+  for (int i = 0; i < 500; i++) {
+    int count = tree->count;
+    tree = DeleteKDTree(tree, built[i]);
+    CHECK(tree == NULL || tree->count == count - 1);
+  }
+  freeTree(tree);
+  return KD_TEST_RESULT();
+}
@@ -0,0 +1,118 @@
+// Time KDTree2fBuild (quickselect into one node array) against buildKDTree
+// (two qsorts per node, one allocation per node) on the same random
+// origin/target sets, built at one interpolation the way a game frame is.
+//
+//   kdtree_bench [--points N] [--repeat N] [--interpolation T]
+#include "alloc_track.h"
+#include "kdtree.h"
+#include "kdtree_instances.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_POINTS 100000
+#define DEFAULT_REPEAT 20
+
+static double Now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+typedef struct BuildTiming {
+  double sumSecs;
+  double minSecs;
+} BuildTiming;
+
+static void AddTiming(BuildTiming *timing, double secs) {
+  timing->sumSecs += secs;
+  if (timing->minSecs == 0.0 || secs < timing->minSecs)
+    timing->minSecs = secs;
+}
+
+int main(int argc, char **argv) {
+  int count = DEFAULT_POINTS;
+  int repeat = DEFAULT_REPEAT;
+  float interpolation = 0.5f;
+  bool badArgs = false;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--points") == 0 && i + 1 < argc)
+      count = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+      repeat = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--interpolation") == 0 && i + 1 < argc)
+      interpolation = (float)atof(argv[++i]);
+    else
+      badArgs = true;
+  }
+  if (badArgs || count < 1 || repeat < 1) {
+    fprintf(stderr,
+            "usage: %s [--points N] [--repeat N] [--interpolation T]\n",
+            argv[0]);
+    return 2;
+  }
+
+  // Pristine sets, copied before every build since both builders reorder
+  // their input in place
+  Vector2 *sourceOrigin = KD_MALLOC(ALLOC_PIPELINE, count * sizeof(Vector2));
+  Vector2 *sourceTarget = KD_MALLOC(ALLOC_PIPELINE, count * sizeof(Vector2));
+  Vector2 *origin = KD_MALLOC(ALLOC_PIPELINE, count * sizeof(Vector2));
+  Vector2 *target = KD_MALLOC(ALLOC_PIPELINE, count * sizeof(Vector2));
+  if (!sourceOrigin || !sourceTarget || !origin || !target) {
+    fprintf(stderr, "out of memory for %d points\n", count);
+    KD_FREE(sourceOrigin);
+    KD_FREE(sourceTarget);
+    KD_FREE(origin);
+    KD_FREE(target);
+    return 1;
+  }
+  srand(1);
+  for (int i = 0; i < count; i++) {
+    sourceOrigin[i] = (Vector2){rand() % 8000 * 0.1f, rand() % 8000 * 0.1f};
+    sourceTarget[i] = (Vector2){rand() % 8000 * 0.1f, rand() % 8000 * 0.1f};
+  }
+
+  BuildTiming pointer = {0};
+  BuildTiming flat = {0};
+  bool sameRoot = true;
+  KDTree2f tree = {0};
+  for (int r = 0; r < repeat; r++) {
+    memcpy(origin, sourceOrigin, count * sizeof(Vector2));
+    memcpy(target, sourceTarget, count * sizeof(Vector2));
+    double start = Now();
+    TreeNode *root = buildKDTree(origin, target, count, 1, NULL, interpolation);
+    AddTiming(&pointer, Now() - start);
+
+    memcpy(origin, sourceOrigin, count * sizeof(Vector2));
+    memcpy(target, sourceTarget, count * sizeof(Vector2));
+    start = Now();
+    bool built = KDTree2fBuild(&tree, KDTree2fFromVector2(origin),
+                               KDTree2fFromVector2(target), count, 1,
+                               interpolation);
+    AddTiming(&flat, Now() - start);
+
+    // Both pick the same median, so the roots must agree
+    sameRoot = sameRoot && built && root != NULL &&
+               root->point.x == tree.nodes[0].point.v[0] &&
+               root->point.y == tree.nodes[0].point.v[1];
+    freeTree(root);
+  }
+  KDTree2fFree(&tree);
+
+  printf("%d points, %d builds each, interpolation %.2f\n", count, repeat,
+         interpolation);
+  printf("buildKDTree    mean %9.3f ms  min %9.3f ms\n",
+         pointer.sumSecs / repeat * 1e3, pointer.minSecs * 1e3);
+  printf("KDTree2fBuild  mean %9.3f ms  min %9.3f ms  (%.1fx)\n",
+         flat.sumSecs / repeat * 1e3, flat.minSecs * 1e3,
+         pointer.sumSecs / flat.sumSecs);
+  if (!sameRoot)
+    fprintf(stderr, "warning: the two builders disagree on the root\n");
+
+  KD_FREE(sourceOrigin);
+  KD_FREE(sourceTarget);
+  KD_FREE(origin);
+  KD_FREE(target);
+  return sameRoot ? 0 : 1;
+}
@@ -0,0 +1,258 @@
+// Replay a frame-loop recording (raylib_game --record FILE) headless and as
+// fast as possible, doing the work the game does before handing lines to
+// raylib. Median frames the game drew from its KDBatch are replayed through
+// a KDBatch flattened once per point set: UpdateKDBatch, the J jitter when it
+// was on, and EmitKDBatchSegments. Every other frame builds the tree with the
+// recorded interpolation and split policy and emits its line segments.
+// Recordings older than version 3 carry no batch progress and are replayed
+// with per-frame builds only.
+//
+//   kdtree_replay FILE [--repeat N] [--min-cell PX] [--csv OUT]
+#include "alloc_track.h"
+#include "kd_batch.h"
+#include "kdtree.h"
+#include "replay.h"
+#include "simplex.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Same window, LOD threshold and jitter amplitude the game draws with
+#define WINDOW_SIZE 800.0f
+#define DEFAULT_MIN_CELL 2.0f
+#define JITTER_PIXELS 4.0f
+
+typedef struct FrameTiming {
+  double buildSecs; // build, or flatten + update + jitter on the batch path
+  double emitSecs;
+  int segments;
+  bool batch;
+} FrameTiming;
+
+static double Now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static int CompareDouble(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// Run the whole recording once, appending one timing per frame. Returns
+// false if the file is malformed.
+static bool ReplayOnce(const char *path, float minCell, FrameTiming **timings,
+                       int *frameCount, int *frameCapacity) {
+  ReplayFile replay;
+  if (!OpenReplayReader(&replay, path)) {
+    fprintf(stderr, "%s: not a readable replay (version %d)\n", path,
+            REPLAY_VERSION);
+    return false;
+  }
+
+  int n = replay.pointCount;
+  Vector2 *origin = KD_MALLOC(ALLOC_PIPELINE, n * sizeof(Vector2));
+  Vector2 *target = KD_MALLOC(ALLOC_PIPELINE, n * sizeof(Vector2));
+  int segmentCapacity = n;
+  Vector2 *segments =
+      KD_MALLOC(ALLOC_PIPELINE, 2 * segmentCapacity * sizeof(Vector2));
+  int sets = 0;
+  bool ok = origin != NULL && target != NULL && segments != NULL;
+  if (!ok)
+    fprintf(stderr, "%s: out of memory for %d points\n", path, n);
+  Rectangle window = {0, 0, WINDOW_SIZE, WINDOW_SIZE};
+
+  // The game's median path: one tree flattened at startup and re-flattened
+  // for every later set. Re-flattening happens inside a frame there, so its
+  // time is charged to the next frame here.
+  KDBatch batch;
+  InitKDBatch(&batch);
+  int batchTree = -1;
+  bool batchCurrent = false;
+  float *noiseScratch = NULL;
+  double flattenSecs = 0.0;
+
+  while (ok) {
+    ReplayEvent event = ReadReplayEvent(&replay);
+    if (event.type == REPLAY_END)
+      break;
+    if (event.type == REPLAY_ERROR) {
+      fprintf(stderr, "%s: truncated or corrupt record\n", path);
+      ok = false;
+      break;
+    }
+    if (event.type == REPLAY_NOISE_SEED) {
+      simplex1d_init_seed(event.seed);
+      continue;
+    }
+
+    if (event.type == REPLAY_POINT_SET) {
+      // Same hand-over as the game: the old target becomes the origin
+      if (sets >= 2) {
+        Vector2 *tmp = origin;
+        origin = target;
+        target = tmp;
+      }
+      memcpy(sets == 0 ? origin : target, event.points, n * sizeof(Vector2));
+      sets++;
+      if (sets == 2) {
+        batchTree = AddKDBatchTree(&batch, origin, target, n, 1, window);
+        batchCurrent = batchTree >= 0;
+        if (batchCurrent)
+          noiseScratch = KD_MALLOC(ALLOC_PIPELINE,
+                                   3 * batch.slotCount * sizeof(float));
+      } else if (sets > 2 && batchTree >= 0) {
+        double start = Now();
+        batchCurrent =
+            SetKDBatchTreePoints(&batch, batchTree, origin, target, n, 1);
+        flattenSecs += Now() - start;
+      }
+      continue;
+    }
+
+    if (sets < 2) {
+      fprintf(stderr, "%s: frame before the initial point sets\n", path);
+      ok = false;
+      break;
+    }
+    if (*frameCount == *frameCapacity) {
+      int capacity = *frameCapacity ? *frameCapacity * 2 : 1024;
+      FrameTiming *grown =
+          KD_REALLOC(ALLOC_PIPELINE, *timings, capacity * sizeof(FrameTiming));
+      if (grown == NULL) {
+        fprintf(stderr, "out of memory after %d frames\n", *frameCount);
+        ok = false;
+        break;
+      }
+      *timings = grown;
+      *frameCapacity = capacity;
+    }
+    FrameTiming *timing = &(*timings)[(*frameCount)++];
+
+    // A batch that could not be flattened here falls back like the game
+    timing->batch = event.progress >= 0.0f && batchCurrent;
+    if (timing->batch) {
+      double start = Now();
+      SetKDBatchTreeProgress(&batch, batchTree, event.progress);
+      UpdateKDBatch(&batch);
+      if (event.jitterTime >= 0.0f && noiseScratch != NULL)
+        JitterKDBatchSplits(&batch, noiseScratch, event.jitterTime,
+                            JITTER_PIXELS);
+      double built = Now();
+      timing->segments =
+          EmitKDBatchSegments(&batch, minCell, segments, segmentCapacity);
+      timing->emitSecs = Now() - built;
+      timing->buildSecs = built - start + flattenSecs;
+    } else {
+      KDBuildOptions options = {.policy = (KDSplitPolicy)event.splitPolicy,
+                                .bounds = window};
+      double start = Now();
+      TreeNode *tree = buildKDTreeEx(origin, target, n, 1, NULL,
+                                     event.interpolation, &options);
+      double built = Now();
+      timing->segments =
+          EmitKDTreeSegments(tree, window, minCell, segments, segmentCapacity);
+      timing->emitSecs = Now() - built;
+      timing->buildSecs = built - start + flattenSecs;
+      freeTree(tree);
+    }
+    flattenSecs = 0.0;
+  }
+
+  KD_FREE(noiseScratch);
+  FreeKDBatch(&batch);
+  KD_FREE(segments);
+  KD_FREE(target);
+  KD_FREE(origin);
+  CloseReplay(&replay);
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  const char *path = NULL;
+  const char *csvPath = NULL;
+  int repeat = 1;
+  float minCell = DEFAULT_MIN_CELL;
+  bool badArgs = false;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+      repeat = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--min-cell") == 0 && i + 1 < argc)
+      minCell = (float)atof(argv[++i]);
+    else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc)
+      csvPath = argv[++i];
+    else if (path == NULL && argv[i][0] != '-')
+      path = argv[i];
+    else
+      badArgs = true;
+  }
+  if (badArgs || path == NULL || repeat < 1) {
+    fprintf(stderr,
+            "usage: %s FILE [--repeat N] [--min-cell PX] [--csv OUT]\n",
+            argv[0]);
+    return 2;
+  }
+
+  FrameTiming *timings = NULL;
+  int frameCount = 0;
+  int frameCapacity = 0;
+  double start = Now();
+  for (int r = 0; r < repeat; r++) {
+    if (!ReplayOnce(path, minCell, &timings, &frameCount, &frameCapacity)) {
+      KD_FREE(timings);
+      return 1;
+    }
+  }
+  double wallSecs = Now() - start;
+  if (frameCount == 0) {
+    fprintf(stderr, "%s: no frames recorded\n", path);
+    KD_FREE(timings);
+    return 1;
+  }
+
+  if (csvPath != NULL) {
+    FILE *csv = fopen(csvPath, "w");
+    if (csv == NULL) {
+      perror(csvPath);
+    } else {
+      fprintf(csv, "frame,path,build_us,emit_us,segments\n");
+      for (int i = 0; i < frameCount; i++) {
+        fprintf(csv, "%d,%s,%.2f,%.2f,%d\n", i,
+                timings[i].batch ? "batch" : "tree",
+                timings[i].buildSecs * 1e6, timings[i].emitSecs * 1e6,
+                timings[i].segments);
+      }
+      fclose(csv);
+    }
+  }
+
+  double *totals = KD_MALLOC(ALLOC_PIPELINE, frameCount * sizeof(double));
+  if (totals == NULL) {
+    fprintf(stderr, "out of memory for %d frame totals\n", frameCount);
+    KD_FREE(timings);
+    return 1;
+  }
+  double buildSum = 0.0;
+  double emitSum = 0.0;
+  int batchFrames = 0;
+  for (int i = 0; i < frameCount; i++) {
+    totals[i] = timings[i].buildSecs + timings[i].emitSecs;
+    buildSum += timings[i].buildSecs;
+    emitSum += timings[i].emitSecs;
+    batchFrames += timings[i].batch;
+  }
+  qsort(totals, frameCount, sizeof(double), CompareDouble);
+  printf("%d frames (%d from the batch) in %.3f s (%.0f frames/s)\n",
+         frameCount, batchFrames, wallSecs, frameCount / wallSecs);
+  printf("per frame us: build %.1f  emit %.1f  total p50 %.1f  p95 %.1f  "
+         "max %.1f\n",
+         buildSum / frameCount * 1e6, emitSum / frameCount * 1e6,
+         totals[frameCount / 2] * 1e6, totals[frameCount * 95 / 100] * 1e6,
+         totals[frameCount - 1] * 1e6);
+  KD_FREE(totals);
+  KD_FREE(timings);
+  return 0;
+}